@@ -0,0 +1,187 @@
+// pthread_setaffinity_np and cpu_set_t are GNU extensions, only needed here
+#define _GNU_SOURCE
+#include "affinity.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void add_cpu(CpuSet *set, int cpu) {
+  set->mask[cpu / 64] |= UINT64_C(1) << (cpu % 64);
+}
+
+static bool has_cpu(const CpuSet *set, int cpu) {
+  return (set->mask[cpu / 64] >> (cpu % 64)) & 1;
+}
+
+static int parse_cpu(const char *str, char **end, int *cpu) {
+  unsigned long value = strtoul(str, end, 10);
+  if (*end == str || value >= AFFINITY_MAX_CPUS) {
+    return 1;
+  }
+  *cpu = (int)value;
+  return 0;
+}
+
+// Parses a list of CPUs and ranges, the format of sysfs cpulist files.
+static int parse_ranges(const char *str, bool allow_nodes, CpuSet *set);
+
+static int add_node(CpuSet *set, const char *node) {
+  char *end;
+  unsigned long value = strtoul(node, &end, 10);
+  if (end == node || (*end != '\0' && *end != ',') || value >= AFFINITY_MAX_NODES) {
+    return 1;
+  }
+
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%lu/cpulist", value);
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    // Machines without NUMA support only have node 0, holding every online CPU
+    if (value != 0) {
+      return 1;
+    }
+    file = fopen("/sys/devices/system/cpu/online", "r");
+    if (file == NULL) {
+      return 1;
+    }
+  }
+
+  char list[1024];
+  int result = 1;
+  if (fgets(list, sizeof(list), file) != NULL) {
+    list[strcspn(list, "\n")] = '\0';
+    result = list[0] == '\0' || parse_ranges(list, false, set);
+  }
+  fclose(file);
+  return result;
+}
+
+static int parse_ranges(const char *str, bool allow_nodes, CpuSet *set) {
+  const char *token = str;
+  while (1) {
+    char *end;
+    if (allow_nodes && strncmp(token, "node", 4) == 0) {
+      if (add_node(set, token + 4) != 0) {
+        return 1;
+      }
+      end = strchr(token, ',');
+      if (end == NULL) {
+        return 0;
+      }
+    } else {
+      int first;
+      int last;
+      if (parse_cpu(token, &end, &first) != 0) {
+        return 1;
+      }
+      last = first;
+      if (*end == '-' && (parse_cpu(end + 1, &end, &last) != 0 || last < first)) {
+        return 1;
+      }
+      for (int cpu = first; cpu <= last; cpu++) {
+        add_cpu(set, cpu);
+      }
+      if (*end == '\0') {
+        return 0;
+      }
+      if (*end != ',') {
+        return 1;
+      }
+    }
+    token = end + 1;
+  }
+}
+
+int cpu_set_parse(const char *str, CpuSet *set) {
+  memset(set, 0, sizeof(CpuSet));
+  return parse_ranges(str, true, set);
+}
+
+bool cpu_set_empty(const CpuSet *set) {
+  return cpu_set_count(set) == 0;
+}
+
+size_t cpu_set_count(const CpuSet *set) {
+  size_t count = 0;
+  for (int i = 0; i < AFFINITY_WORDS; i++) {
+    count += (size_t)__builtin_popcountll(set->mask[i]);
+  }
+  return count;
+}
+
+int cpu_set_nth(const CpuSet *set, size_t position) {
+  position %= cpu_set_count(set);
+  for (int cpu = 0; cpu < AFFINITY_MAX_CPUS; cpu++) {
+    if (has_cpu(set, cpu) && position-- == 0) {
+      return cpu;
+    }
+  }
+  return -1;
+}
+
+void cpu_set_format(const CpuSet *set, char *buf, size_t size) {
+  size_t len = 0;
+  buf[0] = '\0';
+  for (int cpu = 0; cpu < AFFINITY_MAX_CPUS && len < size; cpu++) {
+    if (!has_cpu(set, cpu)) {
+      continue;
+    }
+    int last = cpu;
+    while (last + 1 < AFFINITY_MAX_CPUS && has_cpu(set, last + 1)) {
+      last++;
+    }
+    int written = last == cpu ? snprintf(buf + len, size - len, "%s%d", len > 0 ? "," : "", cpu)
+                              : snprintf(buf + len, size - len, "%s%d-%d", len > 0 ? "," : "", cpu, last);
+    len += written > 0 ? (size_t)written : 0;
+    cpu = last;
+  }
+}
+
+int cpu_node(int cpu) {
+  char path[96];
+  for (int node = 0; node < AFFINITY_MAX_NODES; node++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+    if (access(path, F_OK) == 0) {
+      return node;
+    }
+  }
+  return 0;
+}
+
+int affinity_pin(pthread_t thread, int cpu) {
+  CpuSet set;
+  memset(&set, 0, sizeof(CpuSet));
+  add_cpu(&set, cpu);
+  return affinity_set(thread, &set);
+}
+
+int affinity_get(pthread_t thread, CpuSet *set) {
+  cpu_set_t cpus;
+  memset(set, 0, sizeof(CpuSet));
+  if (pthread_getaffinity_np(thread, sizeof(cpu_set_t), &cpus) != 0) {
+    return 1;
+  }
+
+  for (size_t cpu = 0; cpu < AFFINITY_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &cpus)) {
+      add_cpu(set, (int)cpu);
+    }
+  }
+  return 0;
+}
+
+int affinity_set(pthread_t thread, const CpuSet *set) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (size_t cpu = 0; cpu < AFFINITY_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+    if (has_cpu(set, (int)cpu)) {
+      CPU_SET(cpu, &cpus);
+    }
+  }
+
+  // Fails with EINVAL when none of the CPUs is online, leaving the thread where it was
+  return pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpus) != 0;
+}
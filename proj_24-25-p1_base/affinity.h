@@ -0,0 +1,71 @@
+#ifndef KVS_AFFINITY_H
+#define KVS_AFFINITY_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define AFFINITY_MAX_CPUS 1024
+#define AFFINITY_MAX_NODES 64
+#define AFFINITY_WORDS (AFFINITY_MAX_CPUS / 64)
+
+// Set of CPUs, empty when the threads it applies to are not pinned.
+typedef struct CpuSet {
+  uint64_t mask[AFFINITY_WORDS];
+} CpuSet;
+
+/// Parses a list of CPUs such as "0-3,8", where "node<n>" stands for the
+/// CPUs of a NUMA node (a socket on most machines).
+/// @param str List to parse.
+/// @param set Set to be filled.
+/// @return 0 if the list was parsed successfully, 1 otherwise.
+int cpu_set_parse(const char *str, CpuSet *set);
+
+/// Checks if a set has no CPUs.
+/// @param set Set to inspect.
+/// @return true if the set is empty, false otherwise.
+bool cpu_set_empty(const CpuSet *set);
+
+/// Number of CPUs of a set.
+/// @param set Set to inspect.
+/// @return Number of CPUs.
+size_t cpu_set_count(const CpuSet *set);
+
+/// CPU of a set by position, wrapping around, so threads can be spread over it.
+/// @param set Non-empty set.
+/// @param position Position of the CPU.
+/// @return CPU at position % cpu_set_count(set).
+int cpu_set_nth(const CpuSet *set, size_t position);
+
+/// Writes a set in the syntax of cpu_set_parse.
+/// @param set Set to format.
+/// @param buf Where to write the list.
+/// @param size Size of the buffer.
+void cpu_set_format(const CpuSet *set, char *buf, size_t size);
+
+/// NUMA node of a CPU, read from sysfs.
+/// @param cpu CPU to look up.
+/// @return Node of the CPU, 0 if the machine does not report nodes.
+int cpu_node(int cpu);
+
+/// Pins a thread to a single CPU. Memory the thread touches first is then
+/// allocated on the node of that CPU.
+/// @param thread Thread to pin.
+/// @param cpu CPU to run on.
+/// @return 0 if the thread was pinned, 1 otherwise (it keeps its affinity).
+int affinity_pin(pthread_t thread, int cpu);
+
+/// Reads the CPUs a thread may run on.
+/// @param thread Thread to inspect.
+/// @param set Where to store the CPUs.
+/// @return 0 if the affinity was read, 1 otherwise.
+int affinity_get(pthread_t thread, CpuSet *set);
+
+/// Restricts a thread to a set of CPUs.
+/// @param thread Thread to restrict.
+/// @param set CPUs to run on.
+/// @return 0 if the affinity was changed, 1 otherwise (it keeps its affinity).
+int affinity_set(pthread_t thread, const CpuSet *set);
+
+#endif  // KVS_AFFINITY_H
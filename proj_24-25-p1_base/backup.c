@@ -0,0 +1,142 @@
+#define _XOPEN_SOURCE 700  // realpath
+
+#include "backup.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "constants.h"
+
+void backup_chain_init(BackupChain *chain) {
+  chain->previous[0] = '\0';
+  chain->deltas = 0;
+  chain->previous_ts = 0;
+}
+
+// Bucket-range chunk of a backup being written.
+typedef struct BackupJob {
+  HashTable *ht;
+  const Snapshot *snapshot;
+  uint64_t since;  // Commit of the previous backup, for deltas
+} BackupJob;
+
+// Writes a pair as "(key, value)", or "(key, value, ttl_ms)" with the time it had left at the snapshot.
+// The time left is written rather than the expiration, which only means something to this process' clock.
+static int write_pair_line(FILE *file, const char *key, const Version *version, uint64_t now_ms) {
+  if (version->expires_at == 0) {
+    return fprintf(file, "(%s, %s)\n", key, version->value);
+  }
+  return fprintf(file, "(%s, %s, %u)\n", key, version->value, (unsigned int)(version->expires_at - now_ms));
+}
+
+// Writes every pair of a bucket seen by the snapshot and drops the tombstones it covers.
+static int write_full_bucket(void *arg, size_t task, FILE *file) {
+  BackupJob *job = arg;
+  int i = (int)task;
+  int result = 0;
+
+  for (KeyNode *keyNode = job->ht->table[i]; keyNode != NULL; keyNode = keyNode->next) {
+    const Version *version = snapshot_version(keyNode, job->snapshot);
+    if (version != NULL && write_pair_line(file, keyNode->key, version, job->snapshot->now_ms) < 0) {
+      result = 1;
+    }
+  }
+  free_tombstones(job->ht, take_tombstones(job->ht, i, job->snapshot->ts));
+
+  return result;
+}
+
+// Writes the changes of a bucket committed after since and seen by the snapshot: deleted keys first, then the pairs written.
+static int write_delta_bucket(void *arg, size_t task, FILE *file) {
+  BackupJob *job = arg;
+  int i = (int)task;
+  int result = 0;
+
+  if (atomic_load(&job->ht->changed_at[i]) <= job->since) {
+    return 0;
+  }
+
+  Tombstone *tombstones = take_tombstones(job->ht, i, job->snapshot->ts);
+  for (Tombstone *tombstone = tombstones; tombstone != NULL; tombstone = tombstone->next) {
+    if (fprintf(file, "DELETE (%s)\n", tombstone->key) < 0) {
+      result = 1;
+    }
+  }
+  free_tombstones(job->ht, tombstones);
+
+  for (KeyNode *keyNode = job->ht->table[i]; keyNode != NULL; keyNode = keyNode->next) {
+    const Version *version = version_at(keyNode, job->snapshot->ts);
+    // Deletes are covered by the tombstones
+    if (version == NULL || version->begin <= job->since || version->value == NULL) {
+      continue;
+    }
+
+    int written;
+    if (version_expired(version, job->snapshot->now_ms)) {
+      written = fprintf(file, "DELETE (%s)\n", keyNode->key);
+    } else {
+      written = write_pair_line(file, keyNode->key, version, job->snapshot->now_ms);
+    }
+    if (written < 0) {
+      result = 1;
+    }
+  }
+
+  return result;
+}
+
+// Writes every pair seen by the snapshot, a bucket per task.
+static int write_full(HashTable *ht, WorkerPool *pool, FILE *file, const Snapshot *snapshot) {
+  BackupJob job = {.ht = ht, .snapshot = snapshot, .since = 0};
+  return worker_pool_write(pool, TABLE_SIZE, write_full_bucket, &job, file);
+}
+
+// Writes the changes committed after since and seen by the snapshot, a bucket per task.
+static int write_delta(HashTable *ht, WorkerPool *pool, FILE *file, const char *previous, uint64_t since,
+                       const Snapshot *snapshot) {
+  int result = fprintf(file, DELTA_HEADER "%s\n", previous) < 0;
+  BackupJob job = {.ht = ht, .snapshot = snapshot, .since = since};
+  return worker_pool_write(pool, TABLE_SIZE, write_delta_bucket, &job, file) | result;
+}
+
+int backup_write(HashTable *ht, WorkerPool *pool, BackupChain *chain, const char *path) {
+  // A file that already exists may be one the chain goes through (a job run twice names its backups
+  // the same way), and a delta written over it would make the chain loop
+  int overwrites = access(path, F_OK) == 0;
+
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    perror("Failed to open backup file");
+    return 1;
+  }
+
+  // A delta needs a base, and tombstones that were not recorded (tracking off) cannot be replayed
+  int full = overwrites || chain->previous[0] == '\0' || !atomic_load(&ht->track_changes) ||
+             chain->deltas + 1 >= BACKUP_COMPACT_INTERVAL;
+
+  if (full) {
+    // Deletes committed after the snapshot must leave tombstones for the next delta
+    atomic_store(&ht->track_changes, true);
+  }
+
+  Snapshot snapshot;
+  snapshot_open(ht, &snapshot);
+  int result = full ? write_full(ht, pool, file, &snapshot)
+                    : write_delta(ht, pool, file, chain->previous, chain->previous_ts, &snapshot);
+  snapshot_close(ht, &snapshot);
+  if (fclose(file) != 0) {
+    result = 1;
+  }
+
+  if (result != 0 || realpath(path, chain->previous) == NULL) {
+    // The changes consumed by this backup are lost, so the chain must restart
+    backup_chain_init(chain);
+    return 1;
+  }
+
+  chain->deltas = full ? 0 : chain->deltas + 1;
+  chain->previous_ts = snapshot.ts;
+  return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef KVS_BACKUP_H
+#define KVS_BACKUP_H
+
+#include <limits.h>
+#include <stdint.h>
+
+#include "kvs.h"
+#include "workers.h"
+
+#define DELTA_HEADER "# DELTA "
+
+// Backups form chains: a full snapshot followed by deltas, each one naming
+// the backup it applies to in its first line.
+typedef struct BackupChain {
+  char previous[PATH_MAX];  // Absolute path of the last backup, empty if there is none
+  unsigned int deltas;      // Deltas written since the last full snapshot
+  uint64_t previous_ts;     // Commit the last backup was taken at
+} BackupChain;
+
+/// Initializes an empty chain, so the next backup is a full snapshot.
+/// @param chain Chain to be initialized.
+void backup_chain_init(BackupChain *chain);
+
+/// Writes a backup of the table. The first backup, and every
+/// BACKUP_COMPACT_INTERVAL-th one after it, is a full snapshot; the others
+/// only hold the pairs written and the keys deleted since the previous backup.
+/// A backup over an existing file is always a full snapshot, so the chain of a
+/// new backup never goes through a file rewritten since. Deltas left by an
+/// earlier run may still name a file this run rewrote (a job that makes fewer
+/// backups than before leaves its later ones); restore refuses such a delta, as
+/// its base is newer than it. Pairs with a time to live are written
+/// with the time they had left, which restore counts again from its own start.
+/// The backup reads a snapshot, so writers are not blocked while it is written,
+/// and its buckets are written in parallel, then copied to the file in order.
+/// @param ht Hash table to back up.
+/// @param pool Pool to write the buckets on.
+/// @param chain Chain the backup is appended to.
+/// @param path Path of the backup file.
+/// @return 0 if the backup was written successfully, 1 otherwise.
+int backup_write(HashTable *ht, WorkerPool *pool, BackupChain *chain, const char *path);
+
+#endif  // KVS_BACKUP_H
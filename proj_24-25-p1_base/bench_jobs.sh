@@ -0,0 +1,253 @@
+#!/bin/sh
+# Benchmarks kvs on generated job sets. Each scenario generates its jobs in a
+# scratch directory with a fixed seed, runs them in a fresh kvs for each
+# configuration and prints a line per configuration. Times are wall clock and
+# include starting kvs; the Makefile builds with sanitizers, so they are only
+# meant to be compared with each other.
+# Usage: ./bench_jobs.sh [scenario...] (default: every scenario)
+
+cd "$(dirname "$0")" || exit 1
+KVS="$PWD/kvs"
+SCRATCH=$(mktemp -d) || exit 1
+trap 'rm -rf "$SCRATCH"' EXIT
+SCENARIOS="eviction interning index bloom pipeline pinning small_jobs"
+
+now_ms() {
+  echo $(($(date +%s%N) / 1000000))
+}
+
+# Runs the jobs of a directory in a fresh kvs.
+# $1: directory, then the kvs options.
+# Sets elapsed_ms to the time it took.
+run_jobs() {
+  dir=$1
+  shift
+  rm -f "$dir"/*.out "$dir"/*.bck
+  start=$(now_ms)
+  printf "OPENDIR %s\nQUIT\n" "$dir" | "$KVS" "$@" >/dev/null 2>&1
+  elapsed_ms=$(($(now_ms) - start))
+}
+
+# Captures the commands of the jobs of a directory into <directory>.trace, for replay.
+# $1: directory.
+capture_trace() {
+  rm -f "$1"/*.out "$1"/*.bck
+  printf "OPENDIR %s\nQUIT\n" "$1" | "$KVS" -t "$1.trace" >/dev/null 2>&1
+}
+
+# Replays a trace as fast as possible and prints the latencies of a command.
+# $1: trace, $2: command, then the kvs options.
+replay_latency() {
+  trace=$1
+  command=$2
+  shift 2
+  ./replay -s 0 "$trace" -- "$@" 2>/dev/null |
+    awk -v command="$command" -F'[(), ]+' '$2 == command { printf "%s p50 %7s us  p99 %7s us", command, $4, $6 }'
+}
+
+# Prints a counter of the last STATS of the outputs of a directory.
+# $1: directory, $2: counter name.
+stat_of() {
+  cat "$1"/*.out | awk -v name="$2" -F'[(), ]+' '$2 == name { value = $3 } END { print value + 0 }'
+}
+
+# Prints the hit rate of the READs of the outputs of a directory, in percent.
+# $1: directory.
+hit_rate() {
+  cat "$1"/*.out | awk -F')' '/^\[\(/ { for (i = 1; i < NF; i++) { reads++; if ($i ~ /,KVSERROR$/) misses++ } }
+                              END { printf "%.1f", (reads > 0 ? 100 * (reads - misses) / reads : 0) }'
+}
+
+# Writes a job of commands on keys drawn from a Zipf distribution: key i
+# (of n) is drawn with a probability proportional to 1 / i^s. Keys start with
+# a letter picked by their number, so they spread over the buckets.
+# $1: job path, $2: keys, $3: exponent s, $4: commands, $5: keys per command,
+# $6: percentage of READs (the rest are WRITEs), $7: seed.
+zipf_job() {
+  awk -v n="$2" -v s="$3" -v commands="$4" -v width="$5" -v reads="$6" -v seed="$7" '
+    function key(i) { return substr("abcdefghijklmnopqrstuvwxyz", i % 26 + 1, 1) i }
+    function draw(  u, lo, hi, mid) {
+      u = rand() * cdf[n]
+      lo = 1; hi = n
+      while (lo < hi) { mid = int((lo + hi) / 2); if (cdf[mid] < u) lo = mid + 1; else hi = mid }
+      return lo
+    }
+    BEGIN {
+      srand(seed)
+      for (i = 1; i <= n; i++) cdf[i] = cdf[i - 1] + 1 / i ^ s
+      # Every key is written once before the accesses start
+      for (i = 1; i <= n; i += width) {
+        line = "WRITE ["
+        for (j = i; j < i + width && j <= n; j++) line = line "(" key(j) ",value" j ")"
+        print line "]"
+      }
+      for (c = 0; c < commands; c++) {
+        if (rand() * 100 < reads) {
+          line = "READ ["
+          for (j = 0; j < width; j++) line = line (j > 0 ? "," : "") key(draw())
+        } else {
+          line = "WRITE ["
+          for (j = 0; j < width; j++) { k = draw(); line = line "(" key(k) ",value" k ")" }
+        }
+        print line "]"
+      }
+      print "STATS"
+    }' >"$1"
+}
+
+# Writes a job that fills a single bucket with keys and deletes a share of
+# them, then reads keys of the bucket: written ones, which may have been
+# deleted, and ones that were never written.
+# $1: job path, $2: keys, $3: READ commands, $4: keys per READ, $5: percentage of missing keys read, $6: seed,
+# $7: percentage of the keys deleted before the reads.
+bucket_job() {
+  awk -v n="$2" -v commands="$3" -v width="$4" -v misses="$5" -v seed="$6" -v deleted="${7:-0}" '
+    BEGIN {
+      srand(seed)
+      for (i = 0; i < n; i += 16) {
+        line = "WRITE ["
+        for (j = i; j < i + 16 && j < n; j++) line = line "(a" j ",v" j ")"
+        print line "]"
+      }
+      # Deletes are spread over the keys, so the index is left with tombstones all over it
+      count = 0
+      for (i = 0; i < n; i++) {
+        if ((i * 7919) % 100 >= deleted) continue
+        line = (count % 16 == 0 ? "DELETE [" : line ",") "a" i
+        if (++count % 16 == 0) print line "]"
+      }
+      if (count % 16 != 0) print line "]"
+      for (c = 0; c < commands; c++) {
+        line = "READ ["
+        for (j = 0; j < width; j++) line = line (j > 0 ? "," : "") "a" int(rand() * n) + (rand() * 100 < misses ? n : 0)
+        print line "]"
+      }
+    }' >"$1"
+}
+
+# CLOCK eviction under a skewed workload: hit rate and time at several memory limits.
+bench_eviction() {
+  echo "== eviction: 20000 keys, Zipf s=1, 20000 commands of 8 keys, 80% READs"
+  dir="$SCRATCH/eviction"
+  mkdir -p "$dir"
+  zipf_job "$dir/zipf.job" 20000 1 20000 8 80 27
+  for limit in 256K 512K 1M 2M 0; do
+    run_jobs "$dir" -m "$limit"
+    printf "  -m %-5s %6d ms  hit rate %5s%%  evictions %8d  memory_used %9d\n" "$limit" "$elapsed_ms" \
+      "$(hit_rate "$dir")" "$(stat_of "$dir" evictions)" "$(stat_of "$dir" memory_used)"
+  done
+}
+
+# Group index lookups against walking the bucket chain (-x index), as a bucket grows:
+# READ latency, replayed from a trace, for reads of written keys, reads of keys half
+# of which were never written, and reads after deleting 90% of the keys.
+bench_index() {
+  echo "== index: 2000 READs of 8 keys from a single bucket, with the group index and walking the chain"
+  for keys in 100 1000 10000 50000; do
+    for mix in hits misses deletes; do
+      dir="$SCRATCH/index-$keys-$mix"
+      mkdir -p "$dir"
+      case "$mix" in
+        hits) bucket_job "$dir/bucket.job" "$keys" 2000 8 0 29 0 ;;
+        misses) bucket_job "$dir/bucket.job" "$keys" 2000 8 50 29 0 ;;
+        deletes) bucket_job "$dir/bucket.job" "$keys" 2000 8 0 29 90 ;;
+      esac
+      capture_trace "$dir"
+      printf "  %6d keys  %-7s  index: %s  chain: %s\n" "$keys" "$mix" "$(replay_latency "$dir.trace" READ)" \
+        "$(replay_latency "$dir.trace" READ -x index)"
+    done
+  done
+}
+
+# Bloom filters in front of the index against no filters (-x filter): READ latency as more
+# of the keys read are missing, in front of the group index and of a chain walk.
+bench_bloom() {
+  echo "== bloom: 2000 READs of 8 keys from a bucket of 10000 keys, with a growing share of missing keys"
+  for misses in 0 25 50 75 100; do
+    dir="$SCRATCH/bloom-$misses"
+    mkdir -p "$dir"
+    bucket_job "$dir/bucket.job" 10000 2000 8 "$misses" 31
+    capture_trace "$dir"
+    printf "  %3d%% missing  filter: %s  no filter: %s\n" "$misses" "$(replay_latency "$dir.trace" READ)" \
+      "$(replay_latency "$dir.trace" READ -x filter)"
+    printf "  %12s  filter: %s  no filter: %s  (chain)\n" "" "$(replay_latency "$dir.trace" READ -x index)" \
+      "$(replay_latency "$dir.trace" READ -x index -x filter)"
+  done
+}
+
+# Parsing ahead of execution (-p) and running independent commands in parallel (-g): time of one large job.
+bench_pipeline() {
+  echo "== pipeline: one job of 50000 commands of 4 uniformly drawn keys out of 100000, 50% READs"
+  dir="$SCRATCH/pipeline"
+  mkdir -p "$dir"
+  zipf_job "$dir/large.job" 100000 0 50000 4 50 33
+  for options in "" "-p" "-g -w 2" "-g -w 4"; do
+    # shellcheck disable=SC2086 # Options are split on purpose
+    run_jobs "$dir" $options
+    printf "  %-8s %6d ms\n" "${options:--}" "$elapsed_ms"
+  done
+}
+
+# Pinning the job thread, workers and backups (-c, -b) against leaving them to the scheduler:
+# time of a job that loads, backs up and shows a large table.
+bench_pinning() {
+  echo "== pinning: LOAD of 200000 pairs, 2 BACKUPs and a SHOW, unpinned and pinned"
+  dir="$SCRATCH/pinning"
+  mkdir -p "$dir"
+  awk 'BEGIN { for (i = 0; i < 200000; i++) print substr("abcdefghijklmnopqrstuvwxyz", i % 26 + 1, 1) i ",value" i }' \
+    >"$dir/pairs.txt"
+  printf "LOAD %s\nBACKUP\nWRITE [(a0,new)(b1,new)]\nBACKUP\nSHOW\n" "$dir/pairs.txt" >"$dir/pinning.job"
+  cpus="0-$(($(nproc) - 1))"
+  for options in "" "-c $cpus" "-c node0" "-c $cpus -b $cpus"; do
+    # shellcheck disable=SC2086 # Options are split on purpose
+    run_jobs "$dir" $options
+    printf "  %-20s %6d ms\n" "${options:--}" "$elapsed_ms"
+  done
+}
+
+# Reading jobs ahead and batching their outputs through io_uring (-u): time of many small jobs.
+bench_small_jobs() {
+  echo "== small_jobs: 10000 jobs of 4 commands"
+  dir="$SCRATCH/small_jobs"
+  mkdir -p "$dir"
+  awk -v dir="$dir" 'BEGIN {
+    for (i = 0; i < 10000; i++) {
+      job = sprintf("%s/job%05d.job", dir, i)
+      printf "WRITE [(k%d,v%d)(j%d,v%d)]\nREAD [k%d,j%d]\nDELETE [j%d]\nREAD [k%d,j%d]\n", i, i, i, i, i, i, i, i, i >job
+      close(job)
+    }
+  }'
+  for options in "" "-u" "-p" "-p -u"; do
+    # shellcheck disable=SC2086 # Options are split on purpose
+    run_jobs "$dir" $options
+    printf "  %-6s %6d ms\n" "${options:--}" "$elapsed_ms"
+  done
+}
+
+# Value interning when many keys hold the same values: memory used with and without -i.
+bench_interning() {
+  echo "== interning: 20000 keys holding 16 distinct 32-byte values"
+  dir="$SCRATCH/interning"
+  mkdir -p "$dir"
+  awk 'BEGIN {
+    for (i = 0; i < 20000; i += 16) {
+      line = "WRITE ["
+      for (j = i; j < i + 16; j++) line = line "(k" j "," sprintf("shared-value-%019d", j % 16) ")"
+      print line "]"
+    }
+    print "STATS"
+  }' >"$dir/values.job"
+  for options in "" "-i"; do
+    # shellcheck disable=SC2086 # Options are split on purpose
+    run_jobs "$dir" $options
+    printf "  %-3s %6d ms  memory_used %9d  interned_values %6d\n" "${options:--}" "$elapsed_ms" \
+      "$(stat_of "$dir" memory_used)" "$(stat_of "$dir" interned_values)"
+  done
+}
+
+for scenario in ${@:-$SCENARIOS}; do
+  case " $SCENARIOS " in
+    *" $scenario "*) "bench_$scenario" ;;
+    *) echo "Unknown scenario: $scenario (one of: $SCENARIOS)" >&2; exit 1 ;;
+  esac
+done
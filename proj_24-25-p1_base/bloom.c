@@ -0,0 +1,118 @@
+#include "bloom.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The bucket index already uses the low bits of the hash, so the filter remixes it.
+static uint64_t remix(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+static uint8_t *block_of(const BloomFilter *filter, uint64_t mixed) {
+  size_t block = (size_t)(mixed >> 32) & (filter->blocks - 1);
+  return filter->counters + block * BLOOM_BLOCK_BYTES;
+}
+
+// Position of the i-th counter of a key inside its block.
+static size_t counter_of(uint64_t mixed, int i) {
+  return (size_t)(mixed >> (7 * i)) % BLOOM_BLOCK_COUNTERS;
+}
+
+static uint8_t counter_get(const uint8_t *block, size_t counter) {
+  return (uint8_t)((block[counter / 2] >> (4 * (counter % 2))) & 0x0F);
+}
+
+static void counter_set(uint8_t *block, size_t counter, uint8_t value) {
+  unsigned int shift = 4 * (unsigned int)(counter % 2);
+  block[counter / 2] = (uint8_t)((block[counter / 2] & ~(0x0Fu << shift)) | ((unsigned int)value << shift));
+}
+
+void bloom_init(BloomFilter *filter) {
+  filter->counters = NULL;
+  filter->blocks = 0;
+  filter->bypass = 0;
+}
+
+void bloom_destroy(BloomFilter *filter) {
+  free(filter->counters);
+  bloom_init(filter);
+}
+
+size_t bloom_bytes(const BloomFilter *filter) {
+  return filter->blocks * BLOOM_BLOCK_BYTES;
+}
+
+int bloom_reset(BloomFilter *filter, size_t keys) {
+  size_t blocks = 1;
+  while (blocks * BLOOM_KEYS_PER_BLOCK < keys) {
+    blocks *= 2;
+  }
+
+  if (blocks != filter->blocks) {
+    bloom_destroy(filter);
+    filter->counters = aligned_alloc(BLOOM_BLOCK_BYTES, blocks * BLOOM_BLOCK_BYTES);
+    if (filter->counters == NULL) {
+      filter->bypass = 1;
+      return 1;
+    }
+    filter->blocks = blocks;
+  }
+
+  memset(filter->counters, 0, blocks * BLOOM_BLOCK_BYTES);
+  filter->bypass = 0;
+  return 0;
+}
+
+void bloom_add(BloomFilter *filter, uint64_t hash) {
+  if (filter->blocks == 0) {
+    return;
+  }
+
+  uint64_t mixed = remix(hash);
+  uint8_t *block = block_of(filter, mixed);
+  for (int i = 0; i < BLOOM_HASHES; i++) {
+    size_t counter = counter_of(mixed, i);
+    uint8_t value = counter_get(block, counter);
+    if (value < BLOOM_COUNTER_MAX) {
+      counter_set(block, counter, (uint8_t)(value + 1));
+    }
+  }
+}
+
+void bloom_remove(BloomFilter *filter, uint64_t hash) {
+  if (filter->blocks == 0) {
+    return;
+  }
+
+  uint64_t mixed = remix(hash);
+  uint8_t *block = block_of(filter, mixed);
+  for (int i = 0; i < BLOOM_HASHES; i++) {
+    size_t counter = counter_of(mixed, i);
+    uint8_t value = counter_get(block, counter);
+    // A saturated counter may stand for more keys than it can count
+    if (value > 0 && value < BLOOM_COUNTER_MAX) {
+      counter_set(block, counter, (uint8_t)(value - 1));
+    }
+  }
+}
+
+int bloom_may_contain(const BloomFilter *filter, uint64_t hash) {
+  if (filter->bypass) {
+    return 1;
+  }
+  if (filter->blocks == 0) {
+    return 0;
+  }
+
+  uint64_t mixed = remix(hash);
+  const uint8_t *block = block_of(filter, mixed);
+  for (int i = 0; i < BLOOM_HASHES; i++) {
+    if (counter_get(block, counter_of(mixed, i)) == 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
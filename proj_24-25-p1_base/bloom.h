@@ -0,0 +1,58 @@
+#ifndef KVS_BLOOM_H
+#define KVS_BLOOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLOOM_BLOCK_BYTES 64    // One cache line
+#define BLOOM_BLOCK_COUNTERS (BLOOM_BLOCK_BYTES * 2)
+#define BLOOM_HASHES 4
+#define BLOOM_KEYS_PER_BLOCK 16
+#define BLOOM_COUNTER_MAX 15
+
+// Counting blocked Bloom filter. A key only touches the counters of one
+// block, so a lookup costs a single cache line. The counters are 4 bits, so
+// keys can be removed; a saturated counter is never decremented again (it
+// only costs false positives until the filter is rebuilt).
+typedef struct BloomFilter {
+  uint8_t *counters;   // Two counters per byte
+  size_t blocks;       // Power of two, 0 if the filter is empty
+  int bypass;          // Set if the filter could not be built: every key may be in it
+} BloomFilter;
+
+/// Initializes an empty filter, that holds no keys.
+/// @param filter Filter to be initialized.
+void bloom_init(BloomFilter *filter);
+
+/// Frees the memory of the filter.
+/// @param filter Filter to be destroyed.
+void bloom_destroy(BloomFilter *filter);
+
+/// Clears the filter and sizes it for a number of keys.
+/// @param filter Filter to be reset.
+/// @param keys Number of keys the filter will hold.
+/// @return 0 if the filter was resized successfully, 1 otherwise (the filter is bypassed).
+int bloom_reset(BloomFilter *filter, size_t keys);
+
+/// Bytes allocated by the filter.
+/// @param filter Filter to be measured.
+/// @return Bytes of its counters.
+size_t bloom_bytes(const BloomFilter *filter);
+
+/// Adds a key to the filter.
+/// @param filter Filter to be modified.
+/// @param hash Hash of the key (hash_string).
+void bloom_add(BloomFilter *filter, uint64_t hash);
+
+/// Removes a key that was added to the filter.
+/// @param filter Filter to be modified.
+/// @param hash Hash of the key (hash_string).
+void bloom_remove(BloomFilter *filter, uint64_t hash);
+
+/// Checks if a key may be in the filter.
+/// @param filter Filter to search.
+/// @param hash Hash of the key (hash_string).
+/// @return 0 if the key is certainly not in the filter, 1 if it may be.
+int bloom_may_contain(const BloomFilter *filter, uint64_t hash);
+
+#endif  // KVS_BLOOM_H
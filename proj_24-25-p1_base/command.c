@@ -0,0 +1,152 @@
+#include "command.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "operations.h"
+#include "trace.h"
+
+int command_context_init(CommandContext *context, const char *backup_prefix, size_t prefix_len) {
+  if (prefix_len >= sizeof(context->backup_prefix)) {
+    return 1;
+  }
+
+  memcpy(context->backup_prefix, backup_prefix, prefix_len);
+  context->backup_prefix[prefix_len] = '\0';
+  context->backups = 0;
+  context->session = trace_session(context->backup_prefix);
+  return 0;
+}
+
+void parse_command(int fd, CommandRecord *record) {
+  record->cmd = get_next(fd);
+
+  switch (record->cmd) {
+    case CMD_WRITE:
+      record->num_pairs = parse_write(fd, record->keys, record->values, record->ttls, MAX_WRITE_SIZE, MAX_STRING_SIZE);
+      if (record->num_pairs == 0) {
+        record->cmd = CMD_INVALID;
+      }
+      break;
+
+    case CMD_READ:
+    case CMD_DELETE:
+      record->num_pairs = parse_read_delete(fd, record->keys, MAX_WRITE_SIZE, MAX_STRING_SIZE);
+      if (record->num_pairs == 0) {
+        record->cmd = CMD_INVALID;
+      }
+      break;
+
+    case CMD_WAIT:
+      if (parse_wait(fd, &record->delay, NULL) == -1) {
+        record->cmd = CMD_INVALID;
+      }
+      break;
+
+    case CMD_OPENDIR:
+    case CMD_WATCH:
+    case CMD_LOAD:
+      if (parse_path(fd, record->path, sizeof(record->path)) == 0) {
+        record->cmd = CMD_INVALID;
+      }
+      break;
+
+    case CMD_SHOW:
+    case CMD_STATS:
+    case CMD_HOTKEYS:
+    case CMD_BACKUP:
+    case CMD_HELP:
+    case CMD_EMPTY:
+    case CMD_INVALID:
+    case CMD_QUIT:
+    case EOC:
+      break;
+  }
+}
+
+void execute_command(CommandRecord *record, CommandContext *context) {
+  char backup_path[MAX_JOB_FILE_NAME_SIZE];
+
+  trace_command(context->session, record);
+  switch (record->cmd) {
+    case CMD_WRITE:
+      if (kvs_write(record->num_pairs, record->keys, record->values, record->ttls)) {
+        write(STDERR_FILENO, "Failed to write pair\n", 21);
+      }
+      break;
+
+    case CMD_READ:
+      if (kvs_read(record->num_pairs, record->keys)) {
+        write(STDERR_FILENO, "Failed to read pair\n", 20);
+      }
+      break;
+
+    case CMD_DELETE:
+      if (kvs_delete(record->num_pairs, record->keys)) {
+        write(STDERR_FILENO, "Failed to delete pair\n", 22);
+      }
+      break;
+
+    case CMD_SHOW:
+      kvs_show();
+      break;
+
+    case CMD_STATS:
+      kvs_stats();
+      break;
+
+    case CMD_HOTKEYS:
+      kvs_hotkeys();
+      break;
+
+    case CMD_WAIT:
+      if (record->delay > 0) {
+        fprintf(kvs_output(), "Waiting...\n");
+        kvs_wait(record->delay);
+      }
+      break;
+
+    case CMD_BACKUP:
+      if (snprintf(backup_path, sizeof(backup_path), "%s-%u.bck", context->backup_prefix, ++context->backups) >=
+              (int)sizeof(backup_path) ||
+          kvs_backup(backup_path)) {
+        write(STDERR_FILENO, "Failed to perform backup.\n", 26);
+      }
+      break;
+
+    case CMD_LOAD:
+      if (kvs_load(record->path)) {
+        write(STDERR_FILENO, "Failed to load file\n", 20);
+      }
+      break;
+
+    case CMD_INVALID:
+      write(STDERR_FILENO, "Invalid command. See HELP for usage\n", 36);
+      break;
+
+    case CMD_HELP:
+      fprintf(kvs_output(),
+          "Available commands:\n"
+          "  WRITE [(key,value[,ttl_ms])(key2,value2),...]\n"
+          "  READ [key,key2,...]\n"
+          "  DELETE [key,key2,...]\n"
+          "  SHOW\n"
+          "  STATS\n"
+          "  HOTKEYS\n"
+          "  WAIT <delay_ms>\n"
+          "  BACKUP\n"
+          "  LOAD <file>\n"
+          "  HELP\n"
+      );
+      break;
+
+    case EOC:
+    case CMD_EMPTY:
+    case CMD_OPENDIR:
+    case CMD_WATCH:
+    case CMD_QUIT:
+      // These commands are handled by the prompt, not by jobs
+      break;
+  }
+}
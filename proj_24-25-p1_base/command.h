@@ -0,0 +1,46 @@
+#ifndef KVS_COMMAND_H
+#define KVS_COMMAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "parser.h"
+
+typedef struct CommandRecord {
+  enum Command cmd;            // CMD_INVALID if the arguments could not be parsed
+  size_t num_pairs;            // Pairs of WRITE, keys of READ and DELETE
+  unsigned int delay;          // Delay of WAIT
+  char keys[MAX_WRITE_SIZE][MAX_STRING_SIZE];
+  char values[MAX_WRITE_SIZE][MAX_STRING_SIZE];
+  unsigned int ttls[MAX_WRITE_SIZE];
+  char path[MAX_JOB_FILE_NAME_SIZE];  // Directory of OPENDIR and WATCH, file of LOAD
+} CommandRecord;
+
+typedef struct CommandContext {
+  char backup_prefix[MAX_JOB_FILE_NAME_SIZE];  // Backups are named <prefix>-<n>.bck
+  unsigned int backups;                        // Backups performed so far
+  uint32_t session;                            // Trace session of the commands, 0 if not traced
+} CommandContext;
+
+/// Initializes the context of a job or of the prompt, starting a trace
+/// session named after the prefix if commands are being captured.
+/// @param context Context to be initialized.
+/// @param backup_prefix Prefix of the backup files.
+/// @param prefix_len Length of the prefix.
+/// @return 0 if the prefix fits the context, 1 otherwise.
+int command_context_init(CommandContext *context, const char *backup_prefix, size_t prefix_len);
+
+/// Reads the next command together with its arguments. Only the arguments
+/// of the command are filled, so records can be reused without clearing.
+/// @param fd File descriptor to read from.
+/// @param record Record to store the command in.
+void parse_command(int fd, CommandRecord *record);
+
+/// Executes a parsed command, writing its output to stdout. OPENDIR, WATCH
+/// and QUIT are left to the prompt and ignored here.
+/// @param record Command to be executed.
+/// @param context Context of the job or prompt the command belongs to.
+void execute_command(CommandRecord *record, CommandContext *context);
+
+#endif  // KVS_COMMAND_H
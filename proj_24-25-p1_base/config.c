@@ -0,0 +1,167 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "kvs.h"
+
+// Parses a size with an optional K, M or G suffix.
+static int parse_size(const char *str, size_t *size) {
+  char *end;
+  unsigned long long value = strtoull(str, &end, 10);
+  if (end == str) {
+    return 1;
+  }
+
+  switch (*end) {
+    case 'G':
+    case 'g':
+      value *= 1024;
+      // fall through
+    case 'M':
+    case 'm':
+      value *= 1024;
+      // fall through
+    case 'K':
+    case 'k':
+      value *= 1024;
+      end++;
+      break;
+    default:
+      break;
+  }
+
+  if (*end != '\0') {
+    return 1;
+  }
+
+  *size = (size_t)value;
+  return 0;
+}
+
+static void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -m <bytes>   Memory limit for the table (K, M or G suffix), evicts cold pairs above it\n"
+          "  -i           Intern values, so equal values share a single allocation\n"
+          "  -p           Pipeline jobs, parsing commands on a separate thread ahead of execution\n"
+          "  -g           Run the commands of a job whose keys do not overlap in parallel (over -p)\n"
+          "  -w <threads> Worker threads for parallel commands such as LOAD (default: one per extra CPU)\n"
+          "  -c <cpus>    Pin the job thread and the workers to these CPUs, e.g. 0-3,8 or node0\n"
+          "  -b <cpus>    Run backups on these CPUs\n"
+          "  -t <file>    Capture the executed commands into a trace, see replay\n"
+          "  -u           Read and write job files through io_uring, if the kernel allows it\n"
+          "  -x <part>    Bypass a part of the table lookups, to benchmark it: index (walk the bucket chains)\n"
+          "               or filter (no Bloom filters); may be given twice\n",
+          program);
+}
+
+void config_defaults(KvsConfig *config) {
+  config->memory_limit = 0;
+  config->intern_values = 0;
+  config->pipelined_jobs = 0;
+  config->parallel_commands = 0;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  config->worker_threads = cpus > 1 ? (size_t)cpus - 1 : 0;
+  memset(&config->job_cpus, 0, sizeof(CpuSet));
+  memset(&config->backup_cpus, 0, sizeof(CpuSet));
+  config->trace_path = NULL;
+  config->io_uring_jobs = 0;
+  config->lookup_bypass = 0;
+}
+
+int parse_config(int argc, char *argv[], KvsConfig *config) {
+  int opt;
+  int threads_given = 0;
+
+  config_defaults(config);
+  while ((opt = getopt(argc, argv, "m:ipgw:c:b:t:ux:")) != -1) {
+    switch (opt) {
+      case 'm':
+        if (parse_size(optarg, &config->memory_limit) != 0) {
+          fprintf(stderr, "Invalid memory limit: %s\n", optarg);
+          return 1;
+        }
+        break;
+
+      case 'i':
+        config->intern_values = 1;
+        break;
+
+      case 'p':
+        config->pipelined_jobs = 1;
+        break;
+
+      case 'g':
+        config->parallel_commands = 1;
+        break;
+
+      case 'w': {
+        char *end;
+        unsigned long threads = strtoul(optarg, &end, 10);
+        if (end == optarg || *end != '\0' || threads > MAX_WORKER_THREADS) {
+          fprintf(stderr, "Invalid number of worker threads: %s\n", optarg);
+          return 1;
+        }
+        config->worker_threads = (size_t)threads;
+        threads_given = 1;
+        break;
+      }
+
+      case 'c':
+        if (cpu_set_parse(optarg, &config->job_cpus) != 0 || cpu_set_empty(&config->job_cpus)) {
+          fprintf(stderr, "Invalid job CPUs: %s\n", optarg);
+          return 1;
+        }
+        break;
+
+      case 'b':
+        if (cpu_set_parse(optarg, &config->backup_cpus) != 0 || cpu_set_empty(&config->backup_cpus)) {
+          fprintf(stderr, "Invalid backup CPUs: %s\n", optarg);
+          return 1;
+        }
+        break;
+
+      case 't':
+        config->trace_path = optarg;
+        break;
+
+      case 'u':
+        config->io_uring_jobs = 1;
+        break;
+
+      case 'x':
+        if (strcmp(optarg, "index") == 0) {
+          config->lookup_bypass |= LOOKUP_BYPASS_INDEX;
+        } else if (strcmp(optarg, "filter") == 0) {
+          config->lookup_bypass |= LOOKUP_BYPASS_FILTER;
+        } else {
+          fprintf(stderr, "Invalid lookup part: %s\n", optarg);
+          return 1;
+        }
+        break;
+
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (optind < argc) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  // By default the job thread and the workers take one pinned CPU each
+  if (!threads_given && !cpu_set_empty(&config->job_cpus)) {
+    config->worker_threads = cpu_set_count(&config->job_cpus) - 1;
+    if (config->worker_threads > MAX_WORKER_THREADS) {
+      config->worker_threads = MAX_WORKER_THREADS;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef KVS_CONFIG_H
+#define KVS_CONFIG_H
+
+#include <stddef.h>
+
+#include "affinity.h"
+
+typedef struct KvsConfig {
+  size_t memory_limit;  // Maximum bytes used by the table, 0 for no limit
+  int intern_values;    // Whether equal values share a single allocation
+  int pipelined_jobs;   // Whether jobs are parsed on a separate thread ahead of execution
+  int parallel_commands;  // Whether independent commands of a job run in parallel on the worker pool
+  size_t worker_threads;  // Threads of the worker pool, besides the thread that uses it
+  CpuSet job_cpus;        // CPUs of the job thread and the worker pool, one each, empty to leave them unpinned
+  CpuSet backup_cpus;     // CPUs backups run on, empty to run them wherever the job runs
+  const char *trace_path; // File the executed commands are captured into, NULL to not capture them
+  int io_uring_jobs;      // Whether job files are read and written through io_uring when available
+  int lookup_bypass;      // LOOKUP_BYPASS_* parts of the table lookup path that are skipped, to benchmark them
+} KvsConfig;
+
+/// Fills a configuration with the default values.
+/// @param config Configuration to be filled.
+void config_defaults(KvsConfig *config);
+
+/// Parses the command line options into a configuration.
+/// @param argc Number of arguments.
+/// @param argv Arguments.
+/// @param config Configuration to be filled.
+/// @return 0 if the options were parsed successfully, 1 otherwise.
+int parse_config(int argc, char *argv[], KvsConfig *config);
+
+#endif  // KVS_CONFIG_H
@@ -1,3 +1,8 @@
 #define MAX_WRITE_SIZE 256
 #define MAX_STRING_SIZE 40
 #define MAX_JOB_FILE_NAME_SIZE 256
+#define TTL_TICK_MS 10
+#define BACKUP_COMPACT_INTERVAL 8
+#define PIPELINE_DEPTH 16
+#define JOBGRAPH_WINDOW 256
+#define MAX_WORKER_THREADS 256
@@ -0,0 +1,219 @@
+#include "group_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "kvs.h"
+
+static uint8_t hash_tag(uint64_t hash) {
+  return (uint8_t)(hash & 0x7F);
+}
+
+static size_t hash_group(uint64_t hash, size_t groups) {
+  return (size_t)(hash >> 7) & (groups - 1);
+}
+
+// Bitmask of the slots of a group whose control byte equals value.
+static uint32_t group_match(const uint8_t *group, uint8_t value) {
+#ifdef __SSE2__
+  __m128i ctrl = _mm_load_si128((const __m128i *)(const void *)group);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)value)));
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < GROUP_WIDTH; i++) {
+    if (group[i] == value) {
+      mask |= 1u << i;
+    }
+  }
+  return mask;
+#endif
+}
+
+// Bitmask of the slots of a group that are empty or deleted (high bit set).
+static uint32_t group_match_free(const uint8_t *group) {
+#ifdef __SSE2__
+  __m128i ctrl = _mm_load_si128((const __m128i *)(const void *)group);
+  return (uint32_t)_mm_movemask_epi8(ctrl);
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < GROUP_WIDTH; i++) {
+    if (group[i] & 0x80) {
+      mask |= 1u << i;
+    }
+  }
+  return mask;
+#endif
+}
+
+static int lowest_bit(uint32_t mask) {
+  return __builtin_ctz(mask);
+}
+
+void group_index_init(GroupIndex *index) {
+  index->ctrl = NULL;
+  index->slots = NULL;
+  index->capacity = 0;
+  index->used = 0;
+  index->tombstones = 0;
+}
+
+size_t group_index_bytes(const GroupIndex *index) {
+  return index->capacity * (sizeof(uint8_t) + sizeof(KeyNode *));
+}
+
+void group_index_destroy(GroupIndex *index) {
+  free(index->ctrl);
+  free(index->slots);
+  group_index_init(index);
+}
+
+struct KeyNode *group_index_find(const GroupIndex *index, const char *key, uint64_t hash) {
+  if (index->capacity == 0) {
+    return NULL;
+  }
+
+  size_t groups = index->capacity / GROUP_WIDTH;
+  size_t group = hash_group(hash, groups);
+  uint8_t tag = hash_tag(hash);
+
+  // Triangular probing visits every group once
+  for (size_t step = 1; step <= groups; step++) {
+    const uint8_t *ctrl = index->ctrl + group * GROUP_WIDTH;
+
+    for (uint32_t mask = group_match(ctrl, tag); mask != 0; mask &= mask - 1) {
+      KeyNode *node = index->slots[group * GROUP_WIDTH + (size_t)lowest_bit(mask)];
+      if (node->hash == hash && strcmp(node->key, key) == 0) {
+        return node;
+      }
+    }
+
+    // A group with an empty slot ends every probe sequence that reaches it
+    if (group_match(ctrl, CTRL_EMPTY) != 0) {
+      return NULL;
+    }
+
+    group = (group + step) & (groups - 1);
+  }
+
+  return NULL;
+}
+
+// Places a node in the first free slot of its probe sequence. The index must have room.
+static void place(GroupIndex *index, KeyNode *node) {
+  size_t groups = index->capacity / GROUP_WIDTH;
+  size_t group = hash_group(node->hash, groups);
+
+  for (size_t step = 1;; step++) {
+    uint8_t *ctrl = index->ctrl + group * GROUP_WIDTH;
+    uint32_t mask = group_match_free(ctrl);
+    if (mask != 0) {
+      size_t slot = group * GROUP_WIDTH + (size_t)lowest_bit(mask);
+      if (index->ctrl[slot] == CTRL_DELETED) {
+        index->tombstones--;
+      }
+      index->ctrl[slot] = hash_tag(node->hash);
+      index->slots[slot] = node;
+      index->used++;
+      return;
+    }
+    group = (group + step) & (groups - 1);
+  }
+}
+
+static int rehash(GroupIndex *index, size_t capacity) {
+  uint8_t *ctrl = aligned_alloc(GROUP_WIDTH, capacity);
+  KeyNode **slots = malloc(capacity * sizeof(KeyNode *));
+  if (ctrl == NULL || slots == NULL) {
+    free(ctrl);
+    free(slots);
+    return 1;
+  }
+  memset(ctrl, CTRL_EMPTY, capacity);
+
+  GroupIndex old = *index;
+  index->ctrl = ctrl;
+  index->slots = slots;
+  index->capacity = capacity;
+  index->used = 0;
+  index->tombstones = 0;
+
+  for (size_t i = 0; i < old.capacity; i++) {
+    if ((old.ctrl[i] & 0x80) == 0) {
+      place(index, old.slots[i]);
+    }
+  }
+
+  free(old.ctrl);
+  free(old.slots);
+  return 0;
+}
+
+// Capacity that keeps count nodes under a 7/8 load factor.
+static size_t capacity_for(size_t count) {
+  size_t capacity = GROUP_WIDTH;
+  while (count * 8 > capacity * 7) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+int group_index_reserve(GroupIndex *index, size_t count) {
+  size_t capacity = capacity_for(count);
+  if (capacity <= index->capacity) {
+    return 0;
+  }
+  return rehash(index, capacity);
+}
+
+int group_index_insert(GroupIndex *index, KeyNode *node) {
+  if ((index->used + index->tombstones + 1) * 8 > index->capacity * 7) {
+    // Leave room for as many nodes again, dropping the tombstones on the way
+    if (rehash(index, capacity_for(2 * (index->used + 1))) != 0) {
+      return 1;
+    }
+  }
+
+  place(index, node);
+  return 0;
+}
+
+void group_index_erase(GroupIndex *index, KeyNode *node) {
+  if (index->capacity == 0) {
+    return;
+  }
+
+  size_t groups = index->capacity / GROUP_WIDTH;
+  size_t group = hash_group(node->hash, groups);
+  uint8_t tag = hash_tag(node->hash);
+
+  for (size_t step = 1; step <= groups; step++) {
+    uint8_t *ctrl = index->ctrl + group * GROUP_WIDTH;
+
+    for (uint32_t mask = group_match(ctrl, tag); mask != 0; mask &= mask - 1) {
+      size_t slot = group * GROUP_WIDTH + (size_t)lowest_bit(mask);
+      if (index->slots[slot] == node) {
+        // No probe sequence goes past a group that still has an empty slot,
+        // so the slot can become empty instead of a tombstone
+        if (group_match(ctrl, CTRL_EMPTY) != 0) {
+          index->ctrl[slot] = CTRL_EMPTY;
+        } else {
+          index->ctrl[slot] = CTRL_DELETED;
+          index->tombstones++;
+        }
+        index->slots[slot] = NULL;
+        index->used--;
+        return;
+      }
+    }
+
+    if (group_match(ctrl, CTRL_EMPTY) != 0) {
+      return;
+    }
+
+    group = (group + step) & (groups - 1);
+  }
+}
@@ -0,0 +1,62 @@
+#ifndef KVS_GROUP_INDEX_H
+#define KVS_GROUP_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GROUP_WIDTH 16
+#define CTRL_EMPTY ((uint8_t)0x80)
+#define CTRL_DELETED ((uint8_t)0xFE)
+
+struct KeyNode;
+
+// Open-addressing index of the nodes of a bucket, laid out in groups of
+// GROUP_WIDTH slots. Each slot has a control byte holding 7 bits of the key
+// hash, so a whole group is matched with one SIMD compare and keys are only
+// compared on a tag match.
+typedef struct GroupIndex {
+  uint8_t *ctrl;              // Control bytes, CTRL_EMPTY, CTRL_DELETED or the hash tag
+  struct KeyNode **slots;
+  size_t capacity;            // Number of slots, a power of two multiple of GROUP_WIDTH
+  size_t used;
+  size_t tombstones;
+} GroupIndex;
+
+/// Initializes an empty index. No memory is allocated until the first insert.
+/// @param index Index to be initialized.
+void group_index_init(GroupIndex *index);
+
+/// Frees the memory of the index (not the nodes).
+/// @param index Index to be destroyed.
+void group_index_destroy(GroupIndex *index);
+
+/// Finds the node of a key.
+/// @param index Index to search.
+/// @param key Key to find.
+/// @param hash Hash of the key (hash_string).
+/// @return Node of the key, NULL if it is not indexed.
+struct KeyNode *group_index_find(const GroupIndex *index, const char *key, uint64_t hash);
+
+/// Indexes a node whose key is not indexed yet.
+/// @param index Index to be modified.
+/// @param node Node to be indexed (node->hash must be set).
+/// @return 0 if the node was indexed successfully, 1 otherwise.
+int group_index_insert(GroupIndex *index, struct KeyNode *node);
+
+/// Removes a node from the index.
+/// @param index Index to be modified.
+/// @param node Node to be removed.
+void group_index_erase(GroupIndex *index, struct KeyNode *node);
+
+/// Bytes allocated by the index.
+/// @param index Index to be measured.
+/// @return Bytes of its control bytes and slots.
+size_t group_index_bytes(const GroupIndex *index);
+
+/// Makes room for a number of nodes, so that inserting them does not rehash.
+/// @param index Index to be modified.
+/// @param count Number of nodes the index must hold.
+/// @return 0 if the index was resized successfully, 1 otherwise.
+int group_index_reserve(GroupIndex *index, size_t count);
+
+#endif  // KVS_GROUP_INDEX_H
@@ -0,0 +1,32 @@
+#ifndef KVS_HASH_H
+#define KVS_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// 64-bit FNV-1a hash of a string.
+/// @param str String to hash.
+/// @return hash.
+static inline uint64_t hash_string(const char *str) {
+  uint64_t h = 14695981039346656037ULL;
+  for (const unsigned char *p = (const unsigned char *)str; *p != '\0'; p++) {
+    h ^= *p;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/// 64-bit FNV-1a hash of a byte range, equal to hash_string of the same characters.
+/// @param bytes Bytes to hash.
+/// @param len Number of bytes.
+/// @return hash.
+static inline uint64_t hash_bytes(const char *bytes, size_t len) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)bytes[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+#endif  // KVS_HASH_H
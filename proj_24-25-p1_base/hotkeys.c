@@ -0,0 +1,201 @@
+#include "hotkeys.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct HotCacheEntry {
+  uint64_t generation;      // Generation of the tracker of the entry, 0 if empty
+  uint64_t hash;
+  uint64_t stamp;
+  uint64_t expires_at;
+  char key[MAX_STRING_SIZE];
+  char value[MAX_STRING_SIZE];
+} HotCacheEntry;
+
+static atomic_uint_fast64_t next_generation = 1;
+
+// Per-thread state: the sampling tick and a direct-mapped read cache.
+static _Thread_local unsigned int sample_tick;
+static _Thread_local HotCacheEntry read_cache[HOT_CACHE_ENTRIES];
+
+// Spreads the hash, so each row of the sketch can take its own bits.
+static uint64_t remix(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+static size_t sketch_slot(uint64_t mixed, int row) {
+  return (size_t)(mixed >> (12 * row)) & (HOT_SKETCH_WIDTH - 1);
+}
+
+static uint32_t estimate(HotKeys *hot, uint64_t mixed) {
+  uint32_t count = UINT32_MAX;
+  for (int row = 0; row < HOT_SKETCH_DEPTH; row++) {
+    uint32_t value = atomic_load_explicit(&hot->sketch[row][sketch_slot(mixed, row)], memory_order_relaxed);
+    if (value < count) {
+      count = value;
+    }
+  }
+  return count;
+}
+
+// Recomputes the admission bar of the top list. Must be called with the top lock held.
+static void update_min_top(HotKeys *hot) {
+  uint32_t min = 0;
+  if (hot->num_top == HOT_TOP_KEYS) {
+    min = UINT32_MAX;
+    for (size_t i = 0; i < hot->num_top; i++) {
+      if (hot->top[i].samples < min) {
+        min = hot->top[i].samples;
+      }
+    }
+  }
+  atomic_store(&hot->min_top, min);
+}
+
+static void offer_top(HotKeys *hot, const char *key, uint64_t hash, uint32_t samples) {
+  pthread_mutex_lock(&hot->top_lock);
+  size_t slot = hot->num_top;
+  for (size_t i = 0; i < hot->num_top; i++) {
+    if (hot->top[i].hash == hash && strcmp(hot->top[i].key, key) == 0) {
+      slot = i;
+      break;
+    }
+  }
+
+  if (slot == hot->num_top && hot->num_top == HOT_TOP_KEYS) {
+    // Full: replace the coldest key, if this one is hotter
+    slot = 0;
+    for (size_t i = 1; i < hot->num_top; i++) {
+      if (hot->top[i].samples < hot->top[slot].samples) {
+        slot = i;
+      }
+    }
+    if (hot->top[slot].samples >= samples) {
+      pthread_mutex_unlock(&hot->top_lock);
+      return;
+    }
+  } else if (slot == hot->num_top) {
+    hot->num_top++;
+  }
+
+  strcpy(hot->top[slot].key, key);
+  hot->top[slot].hash = hash;
+  hot->top[slot].samples = samples;
+  update_min_top(hot);
+  pthread_mutex_unlock(&hot->top_lock);
+}
+
+// Halves every count, so keys that cooled down leave the top list.
+static void decay(HotKeys *hot) {
+  for (int row = 0; row < HOT_SKETCH_DEPTH; row++) {
+    for (size_t i = 0; i < HOT_SKETCH_WIDTH; i++) {
+      uint32_t value = atomic_load_explicit(&hot->sketch[row][i], memory_order_relaxed);
+      atomic_store_explicit(&hot->sketch[row][i], value / 2, memory_order_relaxed);
+    }
+  }
+
+  pthread_mutex_lock(&hot->top_lock);
+  for (size_t i = 0; i < hot->num_top; i++) {
+    hot->top[i].samples /= 2;
+  }
+  update_min_top(hot);
+  pthread_mutex_unlock(&hot->top_lock);
+}
+
+HotKeys *create_hot_keys() {
+  // Zeroed memory is a valid initial state for the counters and stamps
+  HotKeys *hot = calloc(1, sizeof(HotKeys));
+  if (hot == NULL) {
+    return NULL;
+  }
+  hot->generation = atomic_fetch_add(&next_generation, 1);
+  pthread_mutex_init(&hot->top_lock, NULL);
+  return hot;
+}
+
+void free_hot_keys(HotKeys *hot) {
+  pthread_mutex_destroy(&hot->top_lock);
+  free(hot);
+}
+
+bool hot_keys_sample(HotKeys *hot, const char *key, uint64_t hash) {
+  if ((++sample_tick & (HOT_SAMPLE_RATE - 1)) != 0) {
+    return false;
+  }
+
+  uint64_t mixed = remix(hash);
+  uint32_t samples = UINT32_MAX;
+  for (int row = 0; row < HOT_SKETCH_DEPTH; row++) {
+    uint32_t value = atomic_fetch_add_explicit(&hot->sketch[row][sketch_slot(mixed, row)], 1, memory_order_relaxed) + 1;
+    if (value < samples) {
+      samples = value;
+    }
+  }
+
+  if ((atomic_fetch_add(&hot->sampled, 1) + 1) % HOT_DECAY_INTERVAL == 0) {
+    decay(hot);
+  }
+
+  if (samples >= HOT_MIN_SAMPLES && samples > atomic_load(&hot->min_top)) {
+    offer_top(hot, key, hash, samples);
+  }
+  return true;
+}
+
+bool hot_keys_is_hot(HotKeys *hot, uint64_t hash) {
+  uint32_t samples = estimate(hot, remix(hash));
+  return samples >= HOT_MIN_SAMPLES && samples >= atomic_load(&hot->min_top);
+}
+
+void hot_keys_bump(HotKeys *hot, uint64_t hash) {
+  atomic_fetch_add(&hot->stamps[hash & (HOT_STAMPS - 1)], 1);
+}
+
+uint64_t hot_keys_stamp(HotKeys *hot, uint64_t hash) {
+  return atomic_load(&hot->stamps[hash & (HOT_STAMPS - 1)]);
+}
+
+char *hot_cache_lookup(HotKeys *hot, const char *key, uint64_t hash, uint64_t now_ms) {
+  const HotCacheEntry *entry = &read_cache[hash & (HOT_CACHE_ENTRIES - 1)];
+  if (entry->generation != hot->generation || entry->hash != hash || strcmp(entry->key, key) != 0) {
+    return NULL;
+  }
+
+  // Any commit of the key (or of one sharing its stamp) since the entry was stored invalidates it
+  if (entry->stamp != hot_keys_stamp(hot, hash) || (entry->expires_at != 0 && entry->expires_at <= now_ms)) {
+    return NULL;
+  }
+  return strdup(entry->value);
+}
+
+void hot_cache_store(HotKeys *hot, const char *key, uint64_t hash, const char *value, uint64_t expires_at,
+                     uint64_t stamp) {
+  HotCacheEntry *entry = &read_cache[hash & (HOT_CACHE_ENTRIES - 1)];
+  entry->generation = hot->generation;
+  entry->hash = hash;
+  entry->stamp = stamp;
+  entry->expires_at = expires_at;
+  strcpy(entry->key, key);
+  strcpy(entry->value, value);
+}
+
+static int compare_hot(const void *a, const void *b) {
+  uint32_t samples_a = ((const HotKey *)a)->samples;
+  uint32_t samples_b = ((const HotKey *)b)->samples;
+  return (samples_a < samples_b) - (samples_a > samples_b);
+}
+
+size_t hot_keys_top(HotKeys *hot, HotKey *keys) {
+  pthread_mutex_lock(&hot->top_lock);
+  size_t count = hot->num_top;
+  memcpy(keys, hot->top, count * sizeof(HotKey));
+  pthread_mutex_unlock(&hot->top_lock);
+
+  qsort(keys, count, sizeof(HotKey), compare_hot);
+  return count;
+}
@@ -0,0 +1,96 @@
+#ifndef KVS_HOTKEYS_H
+#define KVS_HOTKEYS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "constants.h"
+
+#define HOT_SAMPLE_RATE 16        // One read in this many is counted, a power of two
+#define HOT_SKETCH_DEPTH 4
+#define HOT_SKETCH_WIDTH 4096     // Counters per row, a power of two
+#define HOT_TOP_KEYS 16
+#define HOT_MIN_SAMPLES 8         // Sampled reads before a key may be considered hot
+#define HOT_DECAY_INTERVAL 65536  // Sampled reads between two halvings of the counters
+#define HOT_STAMPS 4096           // Version stamps, shared by the keys that hash alike
+#define HOT_CACHE_ENTRIES 64      // Entries of the read cache of each thread, a power of two
+
+typedef struct HotKey {
+  char key[MAX_STRING_SIZE];
+  uint64_t hash;
+  uint32_t samples;         // Estimated sampled reads
+} HotKey;
+
+// Sampled read counting over a count-min sketch, with the most read keys
+// kept aside, plus the version stamps that validate the read caches.
+typedef struct HotKeys {
+  _Atomic(uint32_t) sketch[HOT_SKETCH_DEPTH][HOT_SKETCH_WIDTH];
+  atomic_size_t sampled;                  // Sampled reads, drives the decay
+  pthread_mutex_t top_lock;
+  HotKey top[HOT_TOP_KEYS];               // Unordered
+  size_t num_top;
+  _Atomic(uint32_t) min_top;              // Smallest count of a full top list, 0 while it has room
+  _Atomic(uint64_t) stamps[HOT_STAMPS];   // Bumped by every commit of a key
+  uint64_t generation;                    // Distinct per tracker, so caches never trust a freed one
+} HotKeys;
+
+/// Creates an empty tracker.
+/// @return Newly created tracker, NULL on failure.
+HotKeys *create_hot_keys();
+
+/// Frees a tracker.
+/// @param hot Tracker to be freed.
+void free_hot_keys(HotKeys *hot);
+
+/// Counts a read of a key, one read in HOT_SAMPLE_RATE per thread.
+/// @param hot Tracker.
+/// @param key Key read.
+/// @param hash hash_string of the key.
+/// @return true if the read was sampled (and counted), false otherwise.
+bool hot_keys_sample(HotKeys *hot, const char *key, uint64_t hash);
+
+/// Checks if a key is among the most read ones, without taking any lock.
+/// @param hot Tracker.
+/// @param hash hash_string of the key.
+/// @return true if the key is hot, false otherwise.
+bool hot_keys_is_hot(HotKeys *hot, uint64_t hash);
+
+/// Bumps the version stamp of a key, invalidating its cached copies.
+/// @param hot Tracker.
+/// @param hash hash_string of the key.
+void hot_keys_bump(HotKeys *hot, uint64_t hash);
+
+/// Current version stamp of a key.
+/// @param hot Tracker.
+/// @param hash hash_string of the key.
+/// @return Stamp of the key.
+uint64_t hot_keys_stamp(HotKeys *hot, uint64_t hash);
+
+/// Looks a key up in the read cache of the calling thread.
+/// @param hot Tracker the cache is validated against.
+/// @param key Key to find.
+/// @param hash hash_string of the key.
+/// @param now_ms Current time in milliseconds.
+/// @return Copy of the cached value, NULL if the key is not cached or its stamp changed.
+char *hot_cache_lookup(HotKeys *hot, const char *key, uint64_t hash, uint64_t now_ms);
+
+/// Stores a value in the read cache of the calling thread.
+/// @param hot Tracker the cache is validated against.
+/// @param key Key of the pair.
+/// @param hash hash_string of the key.
+/// @param value Value of the pair.
+/// @param expires_at Expiration time in milliseconds, 0 if the pair never expires.
+/// @param stamp Stamp of the key read together with the value.
+void hot_cache_store(HotKeys *hot, const char *key, uint64_t hash, const char *value, uint64_t expires_at,
+                     uint64_t stamp);
+
+/// Copies the hot keys, most read first.
+/// @param hot Tracker.
+/// @param keys Where to store the keys (HOT_TOP_KEYS entries).
+/// @return Number of keys stored.
+size_t hot_keys_top(HotKeys *hot, HotKey *keys);
+
+#endif  // KVS_HOTKEYS_H
@@ -0,0 +1,98 @@
+#include "intern.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+
+static InternEntry *entry_of(char *value) {
+  return (InternEntry *)(void *)(value - offsetof(InternEntry, value));
+}
+
+InternTable *create_intern_table() {
+  InternTable *intern = malloc(sizeof(InternTable));
+  if (intern == NULL) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < INTERN_BUCKETS; i++) {
+    intern->buckets[i] = NULL;
+  }
+  for (size_t i = 0; i < INTERN_STRIPES; i++) {
+    pthread_mutex_init(&intern->locks[i], NULL);
+  }
+  atomic_init(&intern->entries, 0);
+  return intern;
+}
+
+char *intern_acquire(InternTable *intern, const char *value, size_t *allocated) {
+  uint64_t h = hash_string(value);
+  size_t bucket = (size_t)(h % INTERN_BUCKETS);
+  pthread_mutex_t *lock = &intern->locks[bucket % INTERN_STRIPES];
+
+  *allocated = 0;
+  pthread_mutex_lock(lock);
+  for (InternEntry *entry = intern->buckets[bucket]; entry != NULL; entry = entry->next) {
+    if (entry->hash == h && strcmp(entry->value, value) == 0) {
+      entry->refs++;
+      pthread_mutex_unlock(lock);
+      return entry->value;
+    }
+  }
+
+  size_t len = strlen(value) + 1;
+  InternEntry *entry = malloc(sizeof(InternEntry) + len);
+  if (entry == NULL) {
+    pthread_mutex_unlock(lock);
+    return NULL;
+  }
+  entry->hash = h;
+  entry->refs = 1;
+  memcpy(entry->value, value, len);
+  entry->next = intern->buckets[bucket];
+  intern->buckets[bucket] = entry;
+  pthread_mutex_unlock(lock);
+
+  atomic_fetch_add(&intern->entries, 1);
+  *allocated = sizeof(InternEntry) + len;
+  return entry->value;
+}
+
+size_t intern_release(InternTable *intern, char *value) {
+  InternEntry *entry = entry_of(value);
+  size_t bucket = (size_t)(entry->hash % INTERN_BUCKETS);
+  pthread_mutex_t *lock = &intern->locks[bucket % INTERN_STRIPES];
+
+  pthread_mutex_lock(lock);
+  if (--entry->refs > 0) {
+    pthread_mutex_unlock(lock);
+    return 0;
+  }
+
+  InternEntry **link = &intern->buckets[bucket];
+  while (*link != entry) {
+    link = &(*link)->next;
+  }
+  *link = entry->next;
+  pthread_mutex_unlock(lock);
+
+  size_t freed = sizeof(InternEntry) + strlen(entry->value) + 1;
+  free(entry);
+  atomic_fetch_sub(&intern->entries, 1);
+  return freed;
+}
+
+void free_intern_table(InternTable *intern) {
+  for (size_t i = 0; i < INTERN_BUCKETS; i++) {
+    InternEntry *entry = intern->buckets[i];
+    while (entry != NULL) {
+      InternEntry *next = entry->next;
+      free(entry);
+      entry = next;
+    }
+  }
+  for (size_t i = 0; i < INTERN_STRIPES; i++) {
+    pthread_mutex_destroy(&intern->locks[i]);
+  }
+  free(intern);
+}
@@ -0,0 +1,46 @@
+#ifndef KVS_INTERN_H
+#define KVS_INTERN_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define INTERN_BUCKETS 4096
+#define INTERN_STRIPES 64
+
+typedef struct InternEntry {
+  struct InternEntry *next;
+  uint64_t hash;
+  size_t refs;
+  char value[];
+} InternEntry;
+
+typedef struct InternTable {
+  InternEntry *buckets[INTERN_BUCKETS];
+  pthread_mutex_t locks[INTERN_STRIPES];  // Bucket i is guarded by lock i % INTERN_STRIPES
+  atomic_size_t entries;
+} InternTable;
+
+/// Creates an empty intern table.
+/// @return Newly created intern table, NULL on failure.
+InternTable *create_intern_table();
+
+/// Returns the shared copy of a value, creating it if needed, and takes a reference to it.
+/// @param intern Intern table.
+/// @param value Value to intern.
+/// @param allocated Where to store the bytes allocated for the value (0 if it was already shared).
+/// @return Shared copy of the value, NULL on failure.
+char *intern_acquire(InternTable *intern, const char *value, size_t *allocated);
+
+/// Drops a reference to a shared value, freeing it if it was the last one.
+/// @param intern Intern table.
+/// @param value Shared value returned by intern_acquire.
+/// @return Bytes freed (0 if the value is still referenced).
+size_t intern_release(InternTable *intern, char *value);
+
+/// Frees the intern table and every value left in it.
+/// @param intern Intern table to be freed.
+void free_intern_table(InternTable *intern);
+
+#endif  // KVS_INTERN_H
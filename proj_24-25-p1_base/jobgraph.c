@@ -0,0 +1,280 @@
+#include "jobgraph.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "hash.h"
+#include "kvs.h"
+#include "operations.h"
+
+// Slots of the key table, a power of two with room for every key of a window.
+#define JOBGRAPH_KEY_SLOTS (2 * JOBGRAPH_WINDOW * MAX_WRITE_SIZE)
+
+// Commands of the window that last used a key, by level.
+typedef struct KeyUse {
+  const char *key;        // NULL if the slot is free
+  unsigned int written;   // Level of the last WRITE or DELETE of the key, 0 if there is none
+  unsigned int read;      // Highest level of a READ of the key since then, 0 if there is none
+  bool present;           // Whether the key has a node after the last command placed
+} KeyUse;
+
+// Window of commands being run. A command runs after every command of a lower level.
+struct CommandGraph {
+  CommandRecord *records;  // Commands of the window, in job order
+  size_t count;
+  unsigned int *levels;    // Level of each command, from 1
+  size_t *order;           // Commands sorted by level, in job order within a level
+  size_t *starts;          // Position in order of the first command of each level
+  char **outputs;          // Output of each command
+  size_t *output_sizes;
+  KeyUse *keys;            // Open addressing table of the keys of the window
+  size_t *used;            // Slots of keys taken by the window, cleared after it
+  size_t num_used;
+  unsigned int relinked[TABLE_SIZE];  // Level of the last command that linked or unlinked a node of each bucket
+  size_t level_start;      // Position in order of the level running
+  CommandContext *context; // Context of the job running
+};
+
+void jobgraph_destroy(CommandGraph *graph) {
+  if (graph == NULL) {
+    return;
+  }
+  free(graph->records);
+  free(graph->levels);
+  free(graph->order);
+  free(graph->starts);
+  free(graph->outputs);
+  free(graph->output_sizes);
+  free(graph->keys);
+  free(graph->used);
+  free(graph);
+}
+
+CommandGraph *jobgraph_create() {
+  CommandGraph *graph = calloc(1, sizeof(CommandGraph));
+  if (graph == NULL) {
+    return NULL;
+  }
+
+  graph->records = malloc(JOBGRAPH_WINDOW * sizeof(CommandRecord));
+  graph->count = 0;
+  graph->levels = malloc(JOBGRAPH_WINDOW * sizeof(unsigned int));
+  graph->order = malloc(JOBGRAPH_WINDOW * sizeof(size_t));
+  graph->starts = malloc((JOBGRAPH_WINDOW + 2) * sizeof(size_t));
+  graph->outputs = calloc(JOBGRAPH_WINDOW, sizeof(char *));
+  graph->output_sizes = calloc(JOBGRAPH_WINDOW, sizeof(size_t));
+  graph->keys = calloc(JOBGRAPH_KEY_SLOTS, sizeof(KeyUse));
+  graph->used = malloc(JOBGRAPH_WINDOW * MAX_WRITE_SIZE * sizeof(size_t));
+  graph->num_used = 0;
+  memset(graph->relinked, 0, sizeof(graph->relinked));
+  graph->level_start = 0;
+  graph->context = NULL;
+
+  if (graph->records == NULL || graph->levels == NULL || graph->order == NULL || graph->starts == NULL ||
+      graph->outputs == NULL || graph->output_sizes == NULL || graph->keys == NULL || graph->used == NULL) {
+    jobgraph_destroy(graph);
+    return NULL;
+  }
+  return graph;
+}
+
+// Commands that may touch any pair, or whose output depends on time, run alone.
+static bool is_barrier(enum Command cmd) {
+  switch (cmd) {
+    case CMD_SHOW:
+    case CMD_STATS:
+    case CMD_HOTKEYS:
+    case CMD_WAIT:
+    case CMD_BACKUP:
+    case CMD_LOAD:
+      return true;
+
+    case CMD_WRITE:
+    case CMD_READ:
+    case CMD_DELETE:
+    case CMD_HELP:
+    case CMD_EMPTY:
+    case CMD_INVALID:
+    case CMD_OPENDIR:
+    case CMD_WATCH:
+    case CMD_QUIT:
+    case EOC:
+      break;
+  }
+  return false;
+}
+
+// Finds the use of a key in the window, adding it if it is new.
+static KeyUse *find_key(CommandGraph *graph, const char *key) {
+  size_t mask = JOBGRAPH_KEY_SLOTS - 1;
+  for (size_t slot = (size_t)hash_string(key) & mask;; slot = (slot + 1) & mask) {
+    KeyUse *use = &graph->keys[slot];
+    if (use->key == NULL) {
+      use->key = key;
+      use->present = kvs_has_key(key);
+      graph->used[graph->num_used++] = slot;
+      return use;
+    }
+    if (strcmp(use->key, key) == 0) {
+      return use;
+    }
+  }
+}
+
+// Places a command after the commands it depends on and records its keys.
+// @return Level of the command.
+static unsigned int place_command(CommandGraph *graph, const CommandRecord *record) {
+  bool writes = record->cmd == CMD_WRITE || record->cmd == CMD_DELETE;
+  if (!writes && record->cmd != CMD_READ) {
+    return 1; // Uses no pair
+  }
+
+  KeyUse *uses[MAX_WRITE_SIZE];
+  bool relinks[MAX_WRITE_SIZE];
+  unsigned int level = 1;
+  for (size_t i = 0; i < record->num_pairs; i++) {
+    uses[i] = find_key(graph, record->keys[i]);
+    unsigned int after = uses[i]->written;
+    if (writes && uses[i]->read > after) {
+      after = uses[i]->read;
+    }
+
+    // Nodes are linked at the head of their bucket and SHOW and backups follow
+    // that order, so writes of new keys and deletes keep theirs within a bucket
+    int bucket = hash(record->keys[i]);
+    relinks[i] = writes && bucket >= 0 && (record->cmd == CMD_WRITE) != uses[i]->present;
+    if (relinks[i] && graph->relinked[bucket] > after) {
+      after = graph->relinked[bucket];
+    }
+
+    if (after + 1 > level) {
+      level = after + 1;
+    }
+  }
+
+  for (size_t i = 0; i < record->num_pairs; i++) {
+    if (writes) {
+      uses[i]->written = level;
+      uses[i]->present = record->cmd == CMD_WRITE;
+      if (relinks[i]) {
+        graph->relinked[hash(record->keys[i])] = level;
+      }
+    } else if (uses[i]->read < level) {
+      uses[i]->read = level;
+    }
+  }
+  return level;
+}
+
+// Runs a command of the level running, buffering its output.
+static void run_command(void *arg, size_t task) {
+  CommandGraph *graph = arg;
+  size_t index = graph->order[graph->level_start + task];
+
+  FILE *previous = kvs_output();
+  FILE *out = open_memstream(&graph->outputs[index], &graph->output_sizes[index]);
+  if (out == NULL) {
+    perror("Failed to buffer command output");
+  }
+  // No command of the level writes the keys of a READ, so it needs no snapshot
+  kvs_set_output(out != NULL ? out : stderr);
+  kvs_set_read_snapshots(0);
+  execute_command(&graph->records[index], graph->context);
+  kvs_set_read_snapshots(1);
+  kvs_set_output(previous);
+  if (out != NULL && fclose(out) != 0) {
+    perror("Failed to buffer command output");
+  }
+}
+
+// Runs the commands of the window level by level, then writes their output in job order.
+static void run_window(CommandGraph *graph, WorkerPool *pool, FILE *out) {
+  if (graph->count == 0) {
+    return;
+  }
+
+  unsigned int max_level = 0;
+  memset(graph->starts, 0, (JOBGRAPH_WINDOW + 2) * sizeof(size_t));
+  for (size_t i = 0; i < graph->count; i++) {
+    graph->levels[i] = place_command(graph, &graph->records[i]);
+    graph->starts[graph->levels[i] + 1]++;
+    if (graph->levels[i] > max_level) {
+      max_level = graph->levels[i];
+    }
+  }
+
+  // Counting sort, so each level is a contiguous range of order
+  for (unsigned int level = 1; level <= max_level + 1; level++) {
+    graph->starts[level] += graph->starts[level - 1];
+  }
+  for (size_t i = 0; i < graph->count; i++) {
+    graph->order[graph->starts[graph->levels[i]]++] = i;
+  }
+  for (unsigned int level = max_level + 1; level > 0; level--) {
+    graph->starts[level] = graph->starts[level - 1];
+  }
+
+  for (unsigned int level = 1; level <= max_level; level++) {
+    graph->level_start = graph->starts[level];
+    worker_pool_run(pool, graph->starts[level + 1] - graph->starts[level], run_command, graph);
+  }
+
+  for (size_t i = 0; i < graph->count; i++) {
+    if (graph->outputs[i] != NULL) {
+      fwrite(graph->outputs[i], 1, graph->output_sizes[i], out);
+      free(graph->outputs[i]);
+      graph->outputs[i] = NULL;
+      graph->output_sizes[i] = 0;
+    }
+  }
+
+  for (size_t i = 0; i < graph->num_used; i++) {
+    graph->keys[graph->used[i]].key = NULL;
+    graph->keys[graph->used[i]].written = 0;
+    graph->keys[graph->used[i]].read = 0;
+  }
+  graph->num_used = 0;
+  memset(graph->relinked, 0, sizeof(graph->relinked));
+  graph->count = 0;
+}
+
+int jobgraph_run(CommandGraph *graph, int fd, CommandContext *context, WorkerPool *pool) {
+  // Nothing would run in parallel
+  if (graph == NULL || worker_pool_width(pool) < 2) {
+    return 1;
+  }
+  graph->context = context;
+
+  // Output of the job, commands write to buffers of their own
+  FILE *out = kvs_output();
+  while (1) {
+    // Read up to a barrier, the end of the job or a full window
+    CommandRecord *record = NULL;
+    while (graph->count < JOBGRAPH_WINDOW) {
+      record = &graph->records[graph->count];
+      parse_command(fd, record);
+      if (record->cmd == EOC || is_barrier(record->cmd)) {
+        break;
+      }
+      if (record->cmd != CMD_EMPTY) {
+        graph->count++;
+      }
+      record = NULL;
+    }
+
+    run_window(graph, pool, out);
+    if (record == NULL) {
+      continue; // The window was full
+    }
+    if (record->cmd == EOC) {
+      break;
+    }
+    execute_command(record, context);
+  }
+
+  graph->context = NULL;
+  return 0;
+}
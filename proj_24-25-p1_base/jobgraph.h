@@ -0,0 +1,38 @@
+#ifndef KVS_JOBGRAPH_H
+#define KVS_JOBGRAPH_H
+
+#include "command.h"
+#include "workers.h"
+
+// Window of commands and the tables used to order them, reused across jobs.
+typedef struct CommandGraph CommandGraph;
+
+/// Allocates the window of a graph, about 10 MB with JOBGRAPH_WINDOW at 256.
+/// @return The graph, NULL if it could not be allocated.
+CommandGraph *jobgraph_create();
+
+/// Frees a graph.
+/// @param graph Graph to be freed, may be NULL.
+void jobgraph_destroy(CommandGraph *graph);
+
+/// Runs the commands of a job in parallel where their keys allow it. The job
+/// is read in windows of up to JOBGRAPH_WINDOW commands, ended early by
+/// SHOW, BACKUP, WAIT, STATS, HOTKEYS and LOAD, which act as barriers and
+/// run alone once every command before them is done. Within a window, a
+/// READ runs after the earlier WRITEs and DELETEs of its keys, and a WRITE
+/// or DELETE after every earlier command that uses its keys. WRITEs that
+/// link new nodes and DELETEs that unlink them also keep their order within
+/// a bucket, so SHOW and backups list the pairs in the same order. Commands
+/// that do not depend on each other run at the same time on the pool. Their
+/// output is buffered per command and written in job order, so it matches a
+/// sequential run (except for which pairs are evicted under a memory limit
+/// and the estimates of HOTKEYS).
+/// @param graph Graph to order the commands with, used by one job at a time.
+/// @param fd File descriptor of the job.
+/// @param context Context of the job.
+/// @param pool Pool to run the commands on.
+/// @return 0 if the job ran to the end, 1 if it could not be started
+/// (nothing has been read from fd in that case).
+int jobgraph_run(CommandGraph *graph, int fd, CommandContext *context, WorkerPool *pool);
+
+#endif  // KVS_JOBGRAPH_H
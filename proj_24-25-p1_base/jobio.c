@@ -0,0 +1,418 @@
+// syscall, MAP_POPULATE and the io_uring definitions need the GNU extensions, only needed here
+#define _GNU_SOURCE
+#include "jobio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Rings shared with the kernel, set up with raw system calls.
+typedef struct JobRing {
+  int fd;
+  unsigned int entries;
+  unsigned int *sq_tail;
+  unsigned int *sq_mask;
+  unsigned int *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned int *cq_head;
+  unsigned int *cq_tail;
+  unsigned int *cq_mask;
+  struct io_uring_cqe *cqes;
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring;          // Same mapping as sq_ring if the kernel maps both rings at once
+  size_t cq_ring_size;
+  size_t sqes_size;
+  unsigned int queued;    // Requests not submitted yet
+  unsigned int in_flight; // Requests submitted and not completed
+} JobRing;
+
+// Completions carry the request, outputs tagged in the low bit.
+#define OUTPUT_TAG 1
+
+static void ring_destroy(JobRing *ring) {
+  if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+    munmap(ring->sqes, ring->sqes_size);
+  }
+  if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+  if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED) {
+    munmap(ring->sq_ring, ring->sq_ring_size);
+  }
+  close(ring->fd);
+  free(ring);
+}
+
+// Sets up a ring, NULL if the kernel does not support io_uring (or forbids it).
+static JobRing *ring_create() {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = (int)syscall(__NR_io_uring_setup, JOBIO_RING_ENTRIES, &params);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  JobRing *ring = calloc(1, sizeof(JobRing));
+  if (ring == NULL) {
+    close(fd);
+    return NULL;
+  }
+  ring->fd = fd;
+  ring->entries = params.sq_entries;
+  ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap && ring->cq_ring_size > ring->sq_ring_size) {
+    ring->sq_ring_size = ring->cq_ring_size;
+  }
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                       IORING_OFF_SQ_RING);
+  ring->cq_ring = single_mmap ? ring->sq_ring
+                              : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                     fd, IORING_OFF_CQ_RING);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+    ring_destroy(ring);
+    return NULL;
+  }
+
+  char *sq = ring->sq_ring;
+  char *cq = ring->cq_ring;
+  ring->sq_tail = (unsigned int *)(void *)(sq + params.sq_off.tail);
+  ring->sq_mask = (unsigned int *)(void *)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned int *)(void *)(sq + params.sq_off.array);
+  ring->cq_head = (unsigned int *)(void *)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned int *)(void *)(cq + params.cq_off.tail);
+  ring->cq_mask = (unsigned int *)(void *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(void *)(cq + params.cq_off.cqes);
+  return ring;
+}
+
+static void complete(JobIO *io, uint64_t user_data, int res);
+
+// Submits the queued requests and handles the completions, waiting for at least
+// wait of them. Requests are never more than the submission entries, so the
+// completion ring (twice as large) cannot overflow.
+// @return 0 on success, 1 if the ring failed.
+static int ring_enter(JobIO *io, unsigned int wait) {
+  JobRing *ring = io->ring;
+  long submitted = syscall(__NR_io_uring_enter, ring->fd, ring->queued, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0,
+                           NULL, 0);
+  if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+    perror("Failed to submit job I/O");
+    return 1;
+  }
+  if (submitted > 0) {
+    ring->queued -= (unsigned int)submitted;
+    ring->in_flight += (unsigned int)submitted;
+  }
+
+  unsigned int head = *ring->cq_head;
+  while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+    uint64_t user_data = cqe->user_data;
+    int res = cqe->res;
+    // Released before handling, as the handler may queue (and reap) more requests
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    ring->in_flight--;
+    complete(io, user_data, res);
+    head = *ring->cq_head;
+  }
+  return 0;
+}
+
+// Queues a read or write request.
+// @return 0 if the request was queued, 1 if the ring failed while making room for it.
+static int ring_push(JobIO *io, uint8_t opcode, int fd, void *buf, size_t len, size_t offset, uint64_t user_data) {
+  JobRing *ring = io->ring;
+  while (ring->queued + ring->in_flight >= ring->entries) {
+    if (ring_enter(io, 1) != 0) {
+      return 1;
+    }
+  }
+
+  unsigned int tail = *ring->sq_tail;
+  unsigned int index = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = len > UINT32_MAX ? UINT32_MAX : (uint32_t)len;
+  sqe->off = offset;
+  sqe->user_data = user_data;
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->queued++;
+  return 0;
+}
+
+// Reads the rest of an input without the ring, from where the ring left it.
+static void read_rest(JobInput *input) {
+  while (input->done < input->size) {
+    ssize_t bytes = pread(input->fd, input->data + input->done, input->size - input->done, (off_t)input->done);
+    if (bytes < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes < 0) {
+      input->error = errno;
+      break;
+    }
+    if (bytes == 0) {
+      input->size = input->done;
+      break;
+    }
+    input->done += (size_t)bytes;
+  }
+  input->pending = false;
+}
+
+// Writes data at an offset, retrying short writes.
+// @return 0 if everything was written, 1 otherwise.
+static int write_all(int fd, const char *data, size_t size, size_t offset) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t bytes = pwrite(fd, data + done, size - done, (off_t)(offset + done));
+    if (bytes < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes <= 0) {
+      return 1;
+    }
+    done += (size_t)bytes;
+  }
+  return 0;
+}
+
+static void finish_output(JobIO *io, JobOutput *output);
+
+// Writes the rest of an output without the ring, from where the ring left it.
+static void write_rest(JobIO *io, JobOutput *output) {
+  if (write_all(output->fd, output->data + output->done, output->size - output->done, output->done) != 0) {
+    fprintf(stderr, "Failed to write %s: %s\n", output->path, strerror(errno));
+  }
+  finish_output(io, output);
+}
+
+static void submit_read(JobIO *io, JobInput *input) {
+  if (ring_push(io, IORING_OP_READ, input->fd, input->data + input->done, input->size - input->done, input->done,
+                (uint64_t)(uintptr_t)input) != 0) {
+    read_rest(input);
+  }
+}
+
+static void submit_write(JobIO *io, JobOutput *output) {
+  if (ring_push(io, IORING_OP_WRITE, output->fd, output->data + output->done, output->size - output->done,
+                output->done, (uint64_t)(uintptr_t)output | OUTPUT_TAG) != 0) {
+    write_rest(io, output);
+  }
+}
+
+static void finish_output(JobIO *io, JobOutput *output) {
+  for (JobOutput **link = &io->outputs; *link != NULL; link = &(*link)->next) {
+    if (*link == output) {
+      *link = output->next;
+      break;
+    }
+  }
+  if (close(output->fd) != 0) {
+    perror("Failed to close output file");
+  }
+  free(output->data);
+  free(output);
+}
+
+static void complete(JobIO *io, uint64_t user_data, int res) {
+  if (user_data & OUTPUT_TAG) {
+    JobOutput *output = (JobOutput *)(uintptr_t)(user_data & ~(uint64_t)OUTPUT_TAG);
+    if (res <= 0) {
+      fprintf(stderr, "Failed to write %s: %s\n", output->path, res < 0 ? strerror(-res) : "no progress");
+      finish_output(io, output);
+      return;
+    }
+    output->done += (size_t)res;
+    if (output->done < output->size) {
+      submit_write(io, output); // Short write, write the rest
+    } else {
+      finish_output(io, output);
+    }
+    return;
+  }
+
+  JobInput *input = (JobInput *)(uintptr_t)user_data;
+  if (res < 0) {
+    input->error = -res;
+    input->pending = false;
+  } else if (res == 0) {
+    input->size = input->done; // The file shrank since it was opened
+    input->pending = false;
+  } else {
+    input->done += (size_t)res;
+    if (input->done < input->size) {
+      submit_read(io, input); // Short read, read the rest
+    } else {
+      input->pending = false;
+    }
+  }
+}
+
+void jobio_init(JobIO *io, bool use_uring) {
+  io->ring = use_uring ? ring_create() : NULL;
+  io->outputs = NULL;
+  if (use_uring && io->ring == NULL) {
+    fprintf(stderr, "io_uring is not available, jobs use POSIX I/O\n");
+  }
+}
+
+void jobio_destroy(JobIO *io) {
+  jobio_flush(io);
+  if (io->ring != NULL) {
+    ring_destroy(io->ring);
+    io->ring = NULL;
+  }
+}
+
+bool jobio_uses_uring(const JobIO *io) {
+  return io->ring != NULL;
+}
+
+int jobio_open_input(JobIO *io, const char *path, JobInput *input) {
+  input->data = NULL;
+  input->size = 0;
+  input->done = 0;
+  input->pending = false;
+  input->error = 0;
+
+  input->fd = open(path, O_RDONLY);
+  if (input->fd < 0) {
+    perror("Failed to open input file");
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(input->fd, &st) != 0) {
+    perror("Failed to stat input file");
+    close(input->fd);
+    input->fd = -1;
+    return 1;
+  }
+  input->size = (size_t)st.st_size;
+
+  if (io->ring == NULL || input->size > JOB_PREFETCH_MAX_SIZE) {
+    return 0; // Read when waited for, or parsed from the descriptor
+  }
+
+  input->data = malloc(input->size > 0 ? input->size : 1);
+  if (input->data != NULL && input->size > 0) {
+    input->pending = true;
+    submit_read(io, input);
+  }
+  return 0;
+}
+
+int jobio_wait_input(JobIO *io, JobInput *input) {
+  if (input->fd < 0) {
+    return 1;
+  }
+
+  if (io->ring != NULL) {
+    // Submits what was queued since the last job (outputs and reads ahead) in one call
+    if (io->ring->queued > 0) {
+      ring_enter(io, 0);
+    }
+    while (input->pending) {
+      if (ring_enter(io, 1) != 0) {
+        return 1;
+      }
+    }
+  } else if (input->size <= JOB_PREFETCH_MAX_SIZE && (input->data = malloc(input->size + 1)) != NULL) {
+    while (input->done < input->size) {
+      ssize_t bytes = read(input->fd, input->data + input->done, input->size - input->done);
+      if (bytes < 0 && errno == EINTR) {
+        continue;
+      }
+      if (bytes < 0) {
+        input->error = errno;
+        break;
+      }
+      if (bytes == 0) {
+        input->size = input->done;
+        break;
+      }
+      input->done += (size_t)bytes;
+    }
+  }
+
+  if (input->error != 0) {
+    fprintf(stderr, "Failed to read input file: %s\n", strerror(input->error));
+    return 1;
+  }
+  return 0;
+}
+
+void jobio_close_input(JobIO *io, JobInput *input) {
+  while (input->pending && ring_enter(io, 1) == 0) {
+    // The kernel may still write into the buffer
+  }
+  if (input->pending) {
+    return; // Leaked rather than freed under the kernel
+  }
+  free(input->data);
+  input->data = NULL;
+  if (input->fd >= 0) {
+    close(input->fd);
+    input->fd = -1;
+  }
+}
+
+int jobio_write_output(JobIO *io, const char *path, char *data, size_t size) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror("Failed to open output file");
+    free(data);
+    return 1;
+  }
+
+  JobOutput *output = io->ring != NULL && size > 0 ? malloc(sizeof(JobOutput)) : NULL;
+  if (output == NULL) {
+    int result = write_all(fd, data, size, 0);
+    if (result != 0) {
+      perror("Failed to write output file");
+    }
+    close(fd);
+    free(data);
+    return result;
+  }
+
+  output->fd = fd;
+  output->data = data;
+  output->size = size;
+  output->done = 0;
+  snprintf(output->path, sizeof(output->path), "%s", path);
+  output->next = io->outputs;
+  io->outputs = output;
+  submit_write(io, output);
+  return 0;
+}
+
+void jobio_flush(JobIO *io) {
+  while (io->outputs != NULL) {
+    // Outputs are always queued or in flight, but never wait for a ring with nothing to complete
+    if (io->ring->queued + io->ring->in_flight == 0) {
+      write_rest(io, io->outputs);
+    } else if (ring_enter(io, 1) != 0) {
+      return; // Leaked rather than freed under the kernel
+    }
+  }
+}
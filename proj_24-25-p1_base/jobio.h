@@ -0,0 +1,86 @@
+#ifndef KVS_JOBIO_H
+#define KVS_JOBIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "constants.h"
+
+#define JOBIO_RING_ENTRIES 64
+#define JOB_PREFETCH_DEPTH 8                       // Jobs read ahead of the one running
+#define JOB_PREFETCH_MAX_SIZE (16 * 1024 * 1024)   // Larger jobs are parsed from their descriptor
+
+// Job file being read.
+typedef struct JobInput {
+  int fd;            // -1 if the job could not be opened
+  char *data;        // Contents, NULL if the job is parsed from its descriptor
+  size_t size;
+  size_t done;       // Bytes read so far
+  bool pending;      // Whether a read is in flight
+  int error;         // errno of a failed read, 0 otherwise
+} JobInput;
+
+// Output of a job being written.
+typedef struct JobOutput {
+  int fd;
+  char *data;
+  size_t size;
+  size_t done;       // Bytes written so far
+  char path[MAX_JOB_FILE_NAME_SIZE];
+  struct JobOutput *next;
+} JobOutput;
+
+// Reads jobs ahead and writes their outputs in the background through
+// io_uring, or synchronously through read and write when io_uring is not
+// available. Used by a single thread at a time.
+typedef struct JobIO {
+  struct JobRing *ring;   // NULL when the POSIX fallback is used
+  JobOutput *outputs;     // Writes in flight
+} JobIO;
+
+/// Initializes the job I/O, falling back to POSIX I/O if io_uring is not wanted or not available.
+/// @param io Job I/O to be initialized.
+/// @param use_uring Whether to try io_uring.
+void jobio_init(JobIO *io, bool use_uring);
+
+/// Waits for the writes in flight and releases the job I/O.
+/// @param io Job I/O to be destroyed.
+void jobio_destroy(JobIO *io);
+
+/// Whether io_uring is used.
+/// @param io Job I/O to inspect.
+/// @return true if the io_uring backend is used, false if the POSIX fallback is.
+bool jobio_uses_uring(const JobIO *io);
+
+/// Opens a job and starts reading it in the background (with io_uring).
+/// @param io Job I/O.
+/// @param path Path of the job.
+/// @param input Input to be filled, which must stay in place until closed.
+/// @return 0 if the job was opened, 1 otherwise.
+int jobio_open_input(JobIO *io, const char *path, JobInput *input);
+
+/// Waits for a job to be read, reading it now with the POSIX fallback.
+/// @param io Job I/O.
+/// @param input Opened input.
+/// @return 0 if the job can be parsed, 1 if it could not be read.
+int jobio_wait_input(JobIO *io, JobInput *input);
+
+/// Closes a job, waiting for its read if it is still in flight.
+/// @param io Job I/O.
+/// @param input Input to be closed.
+void jobio_close_input(JobIO *io, JobInput *input);
+
+/// Writes the output of a job, replacing the file. With io_uring the write
+/// is only queued, and submitted with the next batch of requests.
+/// @param io Job I/O.
+/// @param path Path of the output file.
+/// @param data Output, freed by the job I/O once written.
+/// @param size Size of the output.
+/// @return 0 if the write was queued or done, 1 otherwise.
+int jobio_write_output(JobIO *io, const char *path, char *data, size_t size);
+
+/// Waits for every write in flight.
+/// @param io Job I/O.
+void jobio_flush(JobIO *io);
+
+#endif  // KVS_JOBIO_H
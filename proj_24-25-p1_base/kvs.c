@@ -1,4 +1,5 @@
 #include "kvs.h"
+#include "hash.h"
 #include "string.h"
 
 #include <stdlib.h>
@@ -19,91 +20,836 @@ int hash(const char *key) {
 }
 
 
-struct HashTable* create_hash_table() {
+struct HashTable* create_hash_table(size_t memory_limit, int intern_values, int lookup_bypass) {
   HashTable *ht = malloc(sizeof(HashTable));
   if (!ht) return NULL;
+  ht->intern = NULL;
+  if ((ht->hot = create_hot_keys()) == NULL) {
+      free(ht);
+      return NULL;
+  }
+  if (intern_values && (ht->intern = create_intern_table()) == NULL) {
+      free_hot_keys(ht->hot);
+      free(ht);
+      return NULL;
+  }
   for (int i = 0; i < TABLE_SIZE; i++) {
-      ht->table[i] = NULL;
+      atomic_init(&ht->table[i], NULL);
+      ht->tombstones[i] = NULL;
+      ht->garbage[i] = NULL;
+      ht->retired[i] = NULL;
+      atomic_init(&ht->changed_at[i], 0);
+      group_index_init(&ht->index[i]);
+      bloom_init(&ht->filters[i]);
+      pthread_rwlock_init(&ht->locks[i], NULL);
   }
+  if (timer_wheel_init(&ht->wheel) != 0) {
+      for (int i = 0; i < TABLE_SIZE; i++) {
+          pthread_rwlock_destroy(&ht->locks[i]);
+      }
+      if (ht->intern != NULL) {
+          free_intern_table(ht->intern);
+      }
+      free_hot_keys(ht->hot);
+      free(ht);
+      return NULL;
+  }
+  ht->memory_limit = memory_limit;
+  ht->lookup_bypass = lookup_bypass;
+  atomic_init(&ht->memory_used, 0);
+  atomic_init(&ht->pairs, 0);
+  atomic_init(&ht->evictions, 0);
+  atomic_init(&ht->expirations, 0);
+  atomic_init(&ht->stale_versions, 0);
+  pthread_mutex_init(&ht->clock_lock, NULL);
+  ht->clock_hand = 0;
+  atomic_init(&ht->track_changes, false);
+  atomic_init(&ht->garbage_buckets, 0);
+  atomic_init(&ht->commit_ts, 0);
+  pthread_rwlock_init(&ht->commit_gate, NULL);
+  pthread_mutex_init(&ht->snapshot_lock, NULL);
+  ht->snapshots = NULL;
+  ht->newest_snapshot = NULL;
+  atomic_init(&ht->open_snapshots, 0);
   return ht;
 }
 
-int write_pair(HashTable *ht, const char *key, const char *value) {
-    int index = hash(key);
-    KeyNode *keyNode = ht->table[index];
+// Starts a commit in a bucket. Commits take their timestamp and publish their
+// changes with the gate held shared, so a snapshot never sees half of one.
+// The stamp of the key is bumped too, so cached reads of the key go stale.
+// @param h hash_string of the key changed.
+// @param versioned Where to store whether a snapshot is open, in which case the
+// commit must keep what it replaces instead of freeing it.
+// @return Timestamp of the commit.
+static uint64_t commit_begin(HashTable *ht, int index, uint64_t h, bool *versioned) {
+    pthread_rwlock_rdlock(&ht->commit_gate);
+    uint64_t ts = atomic_fetch_add(&ht->commit_ts, 1) + 1;
+    atomic_store(&ht->changed_at[index], ts);
+    hot_keys_bump(ht->hot, h);
+    *versioned = atomic_load(&ht->open_snapshots) > 0;
+    return ts;
+}
 
-    // Search for the key node
-    while (keyNode != NULL) {
-        if (strcmp(keyNode->key, key) == 0) {
-            free(keyNode->value);
-            keyNode->value = strdup(value);
-            return 0;
+static void commit_end(HashTable *ht) {
+    pthread_rwlock_unlock(&ht->commit_gate);
+}
+
+void snapshot_open(HashTable *ht, Snapshot *snapshot) {
+    pthread_mutex_lock(&ht->snapshot_lock);
+    // No commit is half published while the gate is held exclusively
+    pthread_rwlock_wrlock(&ht->commit_gate);
+    snapshot->ts = atomic_load(&ht->commit_ts);
+    atomic_fetch_add(&ht->open_snapshots, 1);
+    pthread_rwlock_unlock(&ht->commit_gate);
+    snapshot->now_ms = timer_now_ms();
+
+    snapshot->prev = ht->newest_snapshot;
+    snapshot->next = NULL;
+    if (ht->newest_snapshot != NULL) {
+        ht->newest_snapshot->next = snapshot;
+    } else {
+        ht->snapshots = snapshot;
+    }
+    ht->newest_snapshot = snapshot;
+    pthread_mutex_unlock(&ht->snapshot_lock);
+}
+
+void snapshot_close(HashTable *ht, Snapshot *snapshot) {
+    pthread_mutex_lock(&ht->snapshot_lock);
+    if (snapshot->prev != NULL) {
+        snapshot->prev->next = snapshot->next;
+    } else {
+        ht->snapshots = snapshot->next;
+    }
+    if (snapshot->next != NULL) {
+        snapshot->next->prev = snapshot->prev;
+    } else {
+        ht->newest_snapshot = snapshot->prev;
+    }
+    atomic_fetch_sub(&ht->open_snapshots, 1);
+    pthread_mutex_unlock(&ht->snapshot_lock);
+}
+
+// Remembers a deleted key for the next delta backup. Must be called with the bucket write lock held.
+static void add_tombstone(HashTable *ht, int index, const char *key, uint64_t ts) {
+    if (!atomic_load(&ht->track_changes)) {
+        return; // Nothing to chain a delta to yet
+    }
+
+    size_t len = strlen(key) + 1;
+    Tombstone *tombstone = malloc(sizeof(Tombstone) + len);
+    if (tombstone == NULL) {
+        // Without the tombstone the next delta would resurrect the key, force a full backup
+        atomic_store(&ht->track_changes, false);
+        return;
+    }
+    memcpy(tombstone->key, key, len);
+    tombstone->ts = ts;
+    tombstone->next = ht->tombstones[index];
+    ht->tombstones[index] = tombstone;
+    atomic_fetch_add(&ht->memory_used, sizeof(Tombstone) + len);
+}
+
+Tombstone *take_tombstones(HashTable *ht, int index, uint64_t ts) {
+    pthread_rwlock_wrlock(&ht->locks[index]);
+    // Newest first, so the tombstones after the commit form a prefix
+    Tombstone **link = &ht->tombstones[index];
+    while (*link != NULL && (*link)->ts > ts) {
+        link = &(*link)->next;
+    }
+    Tombstone *taken = *link;
+    *link = NULL;
+    pthread_rwlock_unlock(&ht->locks[index]);
+    return taken;
+}
+
+void free_tombstones(HashTable *ht, Tombstone *tombstone) {
+    while (tombstone != NULL) {
+        Tombstone *next = tombstone->next;
+        atomic_fetch_sub(&ht->memory_used, sizeof(Tombstone) + strlen(tombstone->key) + 1);
+        free(tombstone);
+        tombstone = next;
+    }
+}
+
+// Bytes accounted for a node holding the given key, without its versions.
+static size_t node_size(const char *key) {
+    return sizeof(KeyNode) + strlen(key) + 1;
+}
+
+// Copies a value, or takes a reference to its shared copy when values are interned.
+// @param allocated Where to store the bytes allocated for the value.
+static char *value_acquire(HashTable *ht, const char *value, size_t *allocated) {
+    if (ht->intern != NULL) {
+        return intern_acquire(ht->intern, value, allocated);
+    }
+
+    char *copy = strdup(value);
+    *allocated = copy != NULL ? strlen(copy) + 1 : 0;
+    return copy;
+}
+
+// Frees a value acquired with value_acquire.
+// @return Bytes freed.
+static size_t value_release(HashTable *ht, char *value) {
+    if (ht->intern != NULL) {
+        return intern_release(ht->intern, value);
+    }
+
+    size_t size = strlen(value) + 1;
+    free(value);
+    return size;
+}
+
+// Frees a list of versions (linked by older) with their values.
+// @return Number of versions freed.
+static size_t free_versions(HashTable *ht, Version *version) {
+    size_t freed = 0;
+    while (version != NULL) {
+        Version *older = version->older;
+        size_t size = sizeof(Version);
+        if (version->value != NULL) {
+            size += value_release(ht, version->value);
         }
-        keyNode = keyNode->next; // Move to the next node
+        atomic_fetch_sub(&ht->memory_used, size);
+        free(version);
+        version = older;
+        freed++;
     }
+    return freed;
+}
 
-    // Key not found, create a new key node
-    keyNode = malloc(sizeof(KeyNode));
+// Frees a node that no reader can reach anymore.
+static void free_node(HashTable *ht, KeyNode *keyNode) {
+    free_versions(ht, atomic_load_explicit(&keyNode->version, memory_order_relaxed));
+    atomic_fetch_sub(&ht->memory_used, node_size(keyNode->key));
+    free(keyNode->key);
+    free(keyNode);
+}
+
+int version_expired(const Version *version, uint64_t now_ms) {
+    return version->expires_at != 0 && version->expires_at <= now_ms;
+}
+
+const Version *version_at(const KeyNode *keyNode, uint64_t ts) {
+    const Version *version = atomic_load_explicit(&keyNode->version, memory_order_acquire);
+    while (version != NULL && version->begin > ts) {
+        version = version->older;
+    }
+    return version;
+}
+
+const Version *snapshot_version(const KeyNode *keyNode, const Snapshot *snapshot) {
+    const Version *version = version_at(keyNode, snapshot->ts);
+    if (version == NULL || version->value == NULL || version_expired(version, snapshot->now_ms)) {
+        return NULL;
+    }
+    return version;
+}
+
+// Newest version of a node, if the pair was not deleted. Must be called with the bucket lock held.
+static Version *live_version(const KeyNode *keyNode) {
+    Version *version = atomic_load_explicit(&keyNode->version, memory_order_relaxed);
+    return version->value != NULL ? version : NULL;
+}
+
+// Finds the node of a key, which may hold a delete not collected yet. Must be called with the bucket lock held.
+static KeyNode *find_node(HashTable *ht, int index, const char *key, uint64_t h) {
+    if (!(ht->lookup_bypass & LOOKUP_BYPASS_FILTER) && !bloom_may_contain(&ht->filters[index], h)) {
+        return NULL;
+    }
+    if (ht->lookup_bypass & LOOKUP_BYPASS_INDEX) {
+        // The index is still kept up to date, only lookups go around it
+        for (KeyNode *keyNode = ht->table[index]; keyNode != NULL; keyNode = keyNode->next) {
+            if (strcmp(keyNode->key, key) == 0) {
+                return keyNode;
+            }
+        }
+        return NULL;
+    }
+    return group_index_find(&ht->index[index], key, h);
+}
+
+// Bytes of the index and filter of a bucket. Must be called with the bucket lock held.
+static size_t bucket_overhead(HashTable *ht, int index) {
+    return group_index_bytes(&ht->index[index]) + bloom_bytes(&ht->filters[index]);
+}
+
+// Charges (or gives back) what the index and filter of a bucket grew (or shrank) by since
+// they took the given bytes. Must be called with the bucket write lock held.
+static void account_overhead(HashTable *ht, int index, size_t before) {
+    size_t after = bucket_overhead(ht, index);
+    if (after > before) {
+        atomic_fetch_add(&ht->memory_used, after - before);
+    } else {
+        atomic_fetch_sub(&ht->memory_used, before - after);
+    }
+}
+
+// Rebuilds the filter of a bucket, sized for its index. Must be called with the bucket write lock held.
+static void rebuild_filter(HashTable *ht, int index) {
+    if (ht->lookup_bypass & LOOKUP_BYPASS_FILTER) {
+        return; // Left without blocks, so adding and removing keys does nothing
+    }
+    if (bloom_reset(&ht->filters[index], ht->index[index].capacity) != 0) {
+        return; // Bypassed until the next rebuild
+    }
+    for (KeyNode *keyNode = ht->table[index]; keyNode != NULL; keyNode = keyNode->next) {
+        bloom_add(&ht->filters[index], keyNode->hash);
+    }
+}
+
+// Queues a node whose replaced versions (or delete) must be collected. Must be called with the bucket write lock held.
+static void queue_garbage(HashTable *ht, int index, KeyNode *keyNode) {
+    if (!keyNode->collect) {
+        keyNode->collect = true;
+        keyNode->garbage_next = ht->garbage[index];
+        ht->garbage[index] = keyNode;
+        atomic_fetch_or(&ht->garbage_buckets, 1u << index);
+    }
+}
+
+// Pushes a new version in front of the newest one. Must be called inside a commit.
+static void push_version(HashTable *ht, int index, KeyNode *keyNode, Version *version) {
+    version->older = atomic_load_explicit(&keyNode->version, memory_order_relaxed);
+    atomic_store_explicit(&keyNode->version, version, memory_order_release);
+    atomic_fetch_add(&ht->stale_versions, 1);
+    queue_garbage(ht, index, keyNode);
+}
+
+// Unlinks a node from its bucket. Its next pointer is kept, so snapshots
+// standing on it can go on. Must be called with the bucket write lock held.
+static void unlink_node(HashTable *ht, int index, KeyNode *keyNode) {
+    group_index_erase(&ht->index[index], keyNode);
+    bloom_remove(&ht->filters[index], keyNode->hash);
+    if (keyNode->prev == NULL) {
+        // Node to delete is the first node in the list
+        ht->table[index] = keyNode->next; // Update the table to point to the next node
+    } else {
+        // Node to delete is not the first; bypass it
+        keyNode->prev->next = keyNode->next; // Link the previous node to the next node
+    }
+    if (keyNode->next != NULL) {
+        keyNode->next->prev = keyNode->prev;
+    }
+}
+
+// Deletes the pair of a node. The node is freed right away unless a snapshot
+// is open (or older versions wait for the collector), in which case a delete
+// version is pushed and the collector unlinks the node later.
+// Must be called with the bucket write lock held.
+// @return 0 if the pair was deleted, 1 if the delete could not be allocated.
+static int remove_node(HashTable *ht, int index, KeyNode *keyNode) {
+    bool versioned;
+    uint64_t ts = commit_begin(ht, index, keyNode->hash, &versioned);
+    bool keep = versioned || keyNode->collect;
+    if (keep) {
+        Version *deletion = malloc(sizeof(Version));
+        if (deletion == NULL) {
+            commit_end(ht);
+            return 1;
+        }
+        deletion->begin = ts;
+        deletion->value = NULL;
+        deletion->expires_at = 0;
+        push_version(ht, index, keyNode, deletion);
+    } else {
+        unlink_node(ht, index, keyNode);
+    }
+    commit_end(ht);
+
+    timer_wheel_cancel(&ht->wheel, &keyNode->timer);
+    add_tombstone(ht, index, keyNode->key, ts);
+    atomic_fetch_sub(&ht->pairs, 1);
+    if (keep) {
+        atomic_fetch_add(&ht->memory_used, sizeof(Version));
+    } else {
+        free_node(ht, keyNode);
+    }
+    return 0;
+}
+
+// Updates the expiration timer of a node. Must be called with the bucket write lock held.
+static int set_expiration(HashTable *ht, KeyNode *keyNode, uint64_t expires_at) {
+    if (expires_at == 0) {
+        timer_wheel_cancel(&ht->wheel, &keyNode->timer);
+        return 0;
+    }
+
+    return timer_wheel_schedule(&ht->wheel, &keyNode->timer, keyNode->key, expires_at);
+}
+
+// Writes a value into an existing node, which may hold a delete. Must be called with the bucket write lock held.
+static int update_node(HashTable *ht, int index, KeyNode *keyNode, const char *value, uint64_t expires_at) {
+    size_t allocated;
+    char *newValue = value_acquire(ht, value, &allocated);
+    if (newValue == NULL) {
+        return 1;
+    }
+    atomic_fetch_add(&ht->memory_used, allocated);
+
+    Version *newest = atomic_load_explicit(&keyNode->version, memory_order_relaxed);
+    char *oldValue = newest->value;
+    bool deleted = oldValue == NULL;
+    bool versioned;
+    uint64_t ts = commit_begin(ht, index, keyNode->hash, &versioned);
+    if (versioned) {
+        Version *version = malloc(sizeof(Version));
+        if (version == NULL) {
+            commit_end(ht);
+            atomic_fetch_sub(&ht->memory_used, value_release(ht, newValue));
+            return 1;
+        }
+        version->begin = ts;
+        version->value = newValue;
+        version->expires_at = expires_at;
+        push_version(ht, index, keyNode, version);
+        atomic_fetch_add(&ht->memory_used, sizeof(Version));
+        oldValue = NULL; // Kept by the replaced version
+    } else {
+        // Nobody else can read the version, overwrite it
+        newest->begin = ts;
+        newest->value = newValue;
+        newest->expires_at = expires_at;
+    }
+    commit_end(ht);
+
+    if (oldValue != NULL) {
+        atomic_fetch_sub(&ht->memory_used, value_release(ht, oldValue));
+    }
+    if (deleted) {
+        atomic_fetch_add(&ht->pairs, 1); // Written again after a delete
+    }
+    atomic_store_explicit(&keyNode->referenced, true, memory_order_relaxed);
+    return set_expiration(ht, keyNode, expires_at);
+}
+
+KeyNode *prepare_node(HashTable *ht, const char *key, const char *value, uint64_t h, uint64_t expires_at) {
+    KeyNode *keyNode = malloc(sizeof(KeyNode));
+    Version *version = malloc(sizeof(Version));
+    if (keyNode == NULL || version == NULL) {
+        free(keyNode);
+        free(version);
+        return NULL;
+    }
+    size_t allocated = 0;
     keyNode->key = strdup(key); // Allocate memory for the key
-    keyNode->value = strdup(value); // Allocate memory for the value
+    version->value = value_acquire(ht, value, &allocated); // Allocate (or share) memory for the value
+    version->expires_at = expires_at;
+    version->older = NULL;
+    if (keyNode->key == NULL || version->value == NULL) {
+        if (version->value != NULL) {
+            value_release(ht, version->value);
+        }
+        free(version);
+        free(keyNode->key);
+        free(keyNode);
+        return NULL;
+    }
+    keyNode->hash = h;
+    atomic_init(&keyNode->version, version);
+    keyNode->timer = NULL;
+    atomic_init(&keyNode->referenced, true);
+    keyNode->collect = false;
+    keyNode->garbage_next = NULL;
+    // Accounted up front, as interned values cannot tell later whether they were shared
+    atomic_fetch_add(&ht->memory_used, node_size(key) + sizeof(Version) + allocated);
+    return keyNode;
+}
+
+// Links an indexed node at the start of its bucket in a commit of its own. Must be called with the bucket write lock held.
+static void link_node(HashTable *ht, int index, KeyNode *keyNode) {
+    bool versioned;
+    Version *version = atomic_load_explicit(&keyNode->version, memory_order_relaxed);
+    version->begin = commit_begin(ht, index, keyNode->hash, &versioned);
+    keyNode->prev = NULL;
     keyNode->next = ht->table[index]; // Link to existing nodes
+    if (keyNode->next != NULL) {
+        keyNode->next->prev = keyNode;
+    }
     ht->table[index] = keyNode; // Place new key node at the start of the list
-    return 0;
+    commit_end(ht);
+    atomic_fetch_add(&ht->pairs, 1);
 }
 
-char* read_pair(HashTable *ht, const char *key) {
+// Writes a pair without enforcing the memory limit.
+static int insert_pair(HashTable *ht, const char *key, const char *value, unsigned int ttl_ms) {
     int index = hash(key);
-    KeyNode *keyNode = ht->table[index];
-    char* value;
+    if (index < 0) {
+        return 1; // Keys must start with a letter or a digit
+    }
+    uint64_t h = hash_string(key);
+    uint64_t expires_at = ttl_ms != 0 ? timer_now_ms() + ttl_ms : 0;
+    pthread_rwlock_wrlock(&ht->locks[index]);
 
-    while (keyNode != NULL) {
-        if (strcmp(keyNode->key, key) == 0) {
-            value = strdup(keyNode->value);
-            return value; // Return copy of the value if found
+    // Search for the key node
+    KeyNode *keyNode = find_node(ht, index, key, h);
+    if (keyNode != NULL) {
+        int result = update_node(ht, index, keyNode, value, expires_at);
+        pthread_rwlock_unlock(&ht->locks[index]);
+        return result;
+    }
+
+    // Key not found, create a new key node
+    size_t capacity = ht->index[index].capacity;
+    size_t overhead = bucket_overhead(ht, index);
+    keyNode = prepare_node(ht, key, value, h, expires_at);
+    if (keyNode == NULL) {
+        pthread_rwlock_unlock(&ht->locks[index]);
+        return 1;
+    }
+    if (group_index_insert(&ht->index[index], keyNode) != 0) {
+        free_node(ht, keyNode);
+        pthread_rwlock_unlock(&ht->locks[index]);
+        return 1;
+    }
+    link_node(ht, index, keyNode);
+
+    if (ht->index[index].capacity != capacity) {
+        rebuild_filter(ht, index); // Keep the filter proportional to the bucket
+    } else {
+        bloom_add(&ht->filters[index], h);
+    }
+    account_overhead(ht, index, overhead);
+    int result = set_expiration(ht, keyNode, expires_at);
+    pthread_rwlock_unlock(&ht->locks[index]);
+    return result;
+}
+
+size_t splice_nodes(HashTable *ht, int index, KeyNode **nodes, size_t count) {
+    size_t spliced = 0;
+    pthread_rwlock_wrlock(&ht->locks[index]);
+    // Grow the index (and its filter) once for the whole batch. If that fails,
+    // inserts grow it as needed and the filter is rebuilt after each growth.
+    size_t capacity = ht->index[index].capacity;
+    size_t overhead = bucket_overhead(ht, index);
+    if (group_index_reserve(&ht->index[index], ht->index[index].used + count) == 0 &&
+        ht->index[index].capacity != capacity) {
+        capacity = ht->index[index].capacity;
+        rebuild_filter(ht, index);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        KeyNode *keyNode = nodes[i];
+        KeyNode *existing = find_node(ht, index, keyNode->key, keyNode->hash);
+        if (existing != NULL || group_index_insert(&ht->index[index], keyNode) != 0) {
+            // Also covers keys repeated within the batch, the last one wins
+            Version *version = atomic_load_explicit(&keyNode->version, memory_order_relaxed);
+            if (existing != NULL && update_node(ht, index, existing, version->value, 0) == 0) {
+                spliced++;
+            }
+            free_node(ht, keyNode);
+            continue;
+        }
+
+        link_node(ht, index, keyNode);
+        if (ht->index[index].capacity != capacity) {
+            // Covers the nodes spliced so far, so later duplicates of the batch are found
+            capacity = ht->index[index].capacity;
+            rebuild_filter(ht, index);
+        } else {
+            bloom_add(&ht->filters[index], keyNode->hash);
+        }
+        spliced++;
+    }
+    account_overhead(ht, index, overhead);
+    pthread_rwlock_unlock(&ht->locks[index]);
+    return spliced;
+}
+
+// Sweeps the buckets with a CLOCK hand, evicting pairs that were not read since the
+// last sweep, until the table fits its memory limit again.
+static void evict_cold_pairs(HashTable *ht) {
+    pthread_mutex_lock(&ht->clock_lock);
+
+    // The first lap may only clear reference bits, the second one evicts
+    for (int visited = 0; visited < 2 * TABLE_SIZE; visited++) {
+        if (atomic_load(&ht->memory_used) <= ht->memory_limit) {
+            break;
+        }
+
+        int index = ht->clock_hand;
+        ht->clock_hand = (ht->clock_hand + 1) % TABLE_SIZE;
+
+        pthread_rwlock_wrlock(&ht->locks[index]);
+        KeyNode *keyNode = ht->table[index];
+        while (keyNode != NULL && atomic_load(&ht->memory_used) > ht->memory_limit) {
+            KeyNode *next = keyNode->next;
+            // Pairs read since the last sweep get a second chance
+            if (live_version(keyNode) != NULL &&
+                !atomic_exchange_explicit(&keyNode->referenced, false, memory_order_relaxed) &&
+                remove_node(ht, index, keyNode) == 0) {
+                atomic_fetch_add(&ht->evictions, 1);
+            }
+            keyNode = next;
         }
-        keyNode = keyNode->next; // Move to the next node
+        pthread_rwlock_unlock(&ht->locks[index]);
+    }
+
+    pthread_mutex_unlock(&ht->clock_lock);
+}
+
+void enforce_memory_limit(HashTable *ht) {
+    // Open snapshots keep what is evicted, so evicting would not free anything until they close
+    if (ht->memory_limit != 0 && atomic_load(&ht->memory_used) > ht->memory_limit &&
+        atomic_load(&ht->open_snapshots) == 0) {
+        evict_cold_pairs(ht);
+    }
+}
+
+int write_pair(HashTable *ht, const char *key, const char *value, unsigned int ttl_ms) {
+    int result = insert_pair(ht, key, value, ttl_ms);
+    enforce_memory_limit(ht);
+    return result;
+}
+
+char* read_pair(HashTable *ht, const char *key, const Snapshot *snapshot) {
+    int index = hash(key);
+    if (index < 0) {
+        return NULL;
+    }
+    uint64_t h = hash_string(key);
+    uint64_t now = timer_now_ms();
+    char* value = NULL;
+
+    // Sampled reads always take the lock, so hot pairs keep their CLOCK reference
+    bool sampled = hot_keys_sample(ht->hot, key, h);
+    if (!sampled && snapshot == NULL && (value = hot_cache_lookup(ht->hot, key, h, now)) != NULL) {
+        return value;
+    }
+
+    pthread_rwlock_rdlock(&ht->locks[index]);
+    KeyNode *keyNode = find_node(ht, index, key, h);
+    if (keyNode != NULL) {
+        const Version *version = snapshot != NULL ? snapshot_version(keyNode, snapshot) : live_version(keyNode);
+        // Expired pairs are hidden until the reaper deletes them
+        if (version != NULL && (snapshot != NULL || !version_expired(version, now))) {
+            value = strdup(version->value); // Return copy of the value if found
+            atomic_store_explicit(&keyNode->referenced, true, memory_order_relaxed);
+            // Commits bump the stamp with the write lock held, so it matches the value read
+            if (snapshot == NULL && hot_keys_is_hot(ht->hot, h)) {
+                hot_cache_store(ht->hot, key, h, version->value, version->expires_at, hot_keys_stamp(ht->hot, h));
+            }
+        }
+    }
+    pthread_rwlock_unlock(&ht->locks[index]);
+    return value;
+}
+
+int has_node(HashTable *ht, const char *key) {
+    int index = hash(key);
+    if (index < 0) {
+        return 0;
     }
-    return NULL; // Key not found
+
+    pthread_rwlock_rdlock(&ht->locks[index]);
+    int found = find_node(ht, index, key, hash_string(key)) != NULL;
+    pthread_rwlock_unlock(&ht->locks[index]);
+    return found;
 }
 
 int delete_pair(HashTable *ht, const char *key) {
     int index = hash(key);
-    KeyNode *keyNode = ht->table[index];
-    KeyNode *prevNode = NULL;
+    if (index < 0) {
+        return 1;
+    }
+    uint64_t h = hash_string(key);
+    uint64_t now = timer_now_ms();
+    pthread_rwlock_wrlock(&ht->locks[index]);
 
     // Search for the key node
-    while (keyNode != NULL) {
-        if (strcmp(keyNode->key, key) == 0) {
-            // Key found; delete this node
-            if (prevNode == NULL) {
-                // Node to delete is the first node in the list
-                ht->table[index] = keyNode->next; // Update the table to point to the next node
+    KeyNode *keyNode = find_node(ht, index, key, h);
+    Version *version = keyNode != NULL ? live_version(keyNode) : NULL;
+    if (version == NULL) {
+        pthread_rwlock_unlock(&ht->locks[index]);
+        return 1;
+    }
+
+    // An expired pair is already gone for the client
+    int expired = version_expired(version, now);
+    int result = remove_node(ht, index, keyNode);
+    pthread_rwlock_unlock(&ht->locks[index]);
+    return expired || result;
+}
+
+size_t reap_expired(HashTable *ht) {
+    uint64_t now = timer_now_ms();
+    TimerEntry *expired = timer_wheel_advance(&ht->wheel, now);
+    size_t reaped = 0;
+
+    for (TimerEntry *entry = expired; entry != NULL; entry = entry->next) {
+        int index = hash(entry->key);
+        pthread_rwlock_wrlock(&ht->locks[index]);
+        KeyNode *keyNode = find_node(ht, index, entry->key, hash_string(entry->key));
+        Version *version = keyNode != NULL ? live_version(keyNode) : NULL;
+        // The pair may have been rewritten since the entry was scheduled
+        if (version != NULL && version_expired(version, now) && remove_node(ht, index, keyNode) == 0) {
+            atomic_fetch_add(&ht->expirations, 1);
+            reaped++;
+        }
+        pthread_rwlock_unlock(&ht->locks[index]);
+    }
+
+    timer_entry_free(expired);
+    return reaped;
+}
+
+// Oldest commit an open (or future) snapshot may read at.
+// @param idle Where to store whether no snapshot was open.
+static uint64_t collect_horizon(HashTable *ht, bool *idle) {
+    pthread_mutex_lock(&ht->snapshot_lock);
+    *idle = ht->snapshots == NULL;
+    uint64_t horizon = *idle ? atomic_load(&ht->commit_ts) : ht->snapshots->ts;
+    pthread_mutex_unlock(&ht->snapshot_lock);
+    return horizon;
+}
+
+// Collects the garbage of a bucket. Must be called with the bucket write lock held.
+static size_t collect_bucket(HashTable *ht, int index, uint64_t horizon, bool idle) {
+    size_t freed = 0;
+
+    // Nodes unlinked before the horizon was taken cannot be reached by newer snapshots
+    KeyNode **link = &ht->retired[index];
+    while (*link != NULL) {
+        KeyNode *keyNode = *link;
+        if (idle || keyNode->retired_at < horizon) {
+            *link = keyNode->garbage_next;
+            free_node(ht, keyNode);
+            freed++;
+        } else {
+            link = &keyNode->garbage_next;
+        }
+    }
+
+    link = &ht->garbage[index];
+    while (*link != NULL) {
+        KeyNode *keyNode = *link;
+        Version *newest = atomic_load_explicit(&keyNode->version, memory_order_relaxed);
+        // Every snapshot reads this version or a newer one, so the older ones can go
+        Version *visible = (Version *)version_at(keyNode, horizon);
+        if (visible != NULL && visible->older != NULL) {
+            size_t count = free_versions(ht, visible->older);
+            visible->older = NULL;
+            atomic_fetch_sub(&ht->stale_versions, count);
+            freed += count;
+        }
+
+        if (visible == newest && newest->value == NULL) {
+            // Deleted for every snapshot: unlink the node, and free it once the
+            // snapshots that may be standing on it are closed
+            *link = keyNode->garbage_next;
+            keyNode->collect = false;
+            pthread_rwlock_rdlock(&ht->commit_gate);
+            unlink_node(ht, index, keyNode);
+            bool reachable = atomic_load(&ht->open_snapshots) > 0;
+            keyNode->retired_at = atomic_load(&ht->commit_ts);
+            pthread_rwlock_unlock(&ht->commit_gate);
+            if (reachable) {
+                keyNode->garbage_next = ht->retired[index];
+                ht->retired[index] = keyNode;
             } else {
-                // Node to delete is not the first; bypass it
-                prevNode->next = keyNode->next; // Link the previous node to the next node
+                free_node(ht, keyNode);
+                freed++;
             }
-            // Free the memory allocated for the key and value
-            free(keyNode->key);
-            free(keyNode->value);
-            free(keyNode); // Free the key node itself
-            return 0; // Exit the function
+        } else if (newest->older == NULL) {
+            *link = keyNode->garbage_next;
+            keyNode->collect = false;
+        } else {
+            link = &keyNode->garbage_next;
+        }
+    }
+
+    if (ht->garbage[index] != NULL || ht->retired[index] != NULL) {
+        atomic_fetch_or(&ht->garbage_buckets, 1u << index);
+    }
+    return freed;
+}
+
+size_t collect_garbage(HashTable *ht) {
+    unsigned int buckets = atomic_load(&ht->garbage_buckets);
+    if (buckets == 0) {
+        return 0;
+    }
+
+    bool idle;
+    uint64_t horizon = collect_horizon(ht, &idle);
+    size_t freed = 0;
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        if ((buckets & (1u << i)) == 0) {
+            continue;
         }
-        prevNode = keyNode; // Move prevNode to current node
-        keyNode = keyNode->next; // Move to the next node
+
+        pthread_rwlock_wrlock(&ht->locks[i]);
+        atomic_fetch_and(&ht->garbage_buckets, ~(1u << i));
+        freed += collect_bucket(ht, i, horizon, idle);
+        pthread_rwlock_unlock(&ht->locks[i]);
     }
-    
-    return 1;
+    return freed;
+}
+
+void table_stats(HashTable *ht, TableStats *stats) {
+    stats->pairs = atomic_load(&ht->pairs);
+    stats->memory_used = atomic_load(&ht->memory_used);
+    stats->memory_limit = ht->memory_limit;
+    stats->evictions = atomic_load(&ht->evictions);
+    stats->expirations = atomic_load(&ht->expirations);
+    stats->interned_values = ht->intern != NULL ? atomic_load(&ht->intern->entries) : 0;
+    stats->stale_versions = atomic_load(&ht->stale_versions);
+}
+
+// Frees a node and its versions when the whole table goes away.
+static void destroy_node(HashTable *ht, KeyNode *keyNode) {
+    Version *version = atomic_load_explicit(&keyNode->version, memory_order_relaxed);
+    size_t size = node_size(keyNode->key);
+    while (version != NULL) {
+        Version *older = version->older;
+        size += sizeof(Version);
+        if (ht->intern == NULL && version->value != NULL) {
+            size += strlen(version->value) + 1;
+            free(version->value); // Shared values are freed with the intern table
+        }
+        free(version);
+        version = older;
+    }
+    atomic_fetch_sub(&ht->memory_used, size);
+    free(keyNode->key);
+    free(keyNode);
+}
+
+void clear_bucket(HashTable *ht, int index) {
+    KeyNode *keyNode = ht->table[index];
+    while (keyNode != NULL) {
+        KeyNode *temp = keyNode;
+        keyNode = keyNode->next;
+        destroy_node(ht, temp);
+    }
+    keyNode = ht->retired[index];
+    while (keyNode != NULL) {
+        KeyNode *temp = keyNode;
+        keyNode = keyNode->garbage_next;
+        destroy_node(ht, temp);
+    }
+    ht->table[index] = NULL;
+    ht->retired[index] = NULL;
+    atomic_fetch_sub(&ht->memory_used, bucket_overhead(ht, index));
+    group_index_destroy(&ht->index[index]);
+    bloom_destroy(&ht->filters[index]);
+    free_tombstones(ht, ht->tombstones[index]);
+    ht->tombstones[index] = NULL;
 }
 
 void free_table(HashTable *ht) {
     for (int i = 0; i < TABLE_SIZE; i++) {
-        KeyNode *keyNode = ht->table[i];
-        while (keyNode != NULL) {
-            KeyNode *temp = keyNode;
-            keyNode = keyNode->next;
-            free(temp->key);
-            free(temp->value);
-            free(temp);
-        }
+        clear_bucket(ht, i);
+        pthread_rwlock_destroy(&ht->locks[i]);
+    }
+    if (ht->intern != NULL) {
+        free_intern_table(ht->intern);
     }
-}
\ No newline at end of file
+    free_hot_keys(ht->hot);
+    timer_wheel_destroy(&ht->wheel);
+    pthread_mutex_destroy(&ht->clock_lock);
+    pthread_rwlock_destroy(&ht->commit_gate);
+    pthread_mutex_destroy(&ht->snapshot_lock);
+    free(ht);
+}
@@ -3,34 +3,150 @@
 
 #define TABLE_SIZE 26
 
+// Parts of the lookup path that can be bypassed, to measure what they save
+#define LOOKUP_BYPASS_INDEX 1 // Walk the bucket chain instead of probing the group index
+#define LOOKUP_BYPASS_FILTER 2 // Leave the Bloom filters empty and look every key up
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "bloom.h"
+#include "group_index.h"
+#include "hotkeys.h"
+#include "intern.h"
+#include "timer_wheel.h"
+
+// Value of a pair as of a commit. While a snapshot is open, writes push a new
+// version instead of overwriting, so the snapshot keeps reading its own.
+typedef struct Version {
+    uint64_t begin; // Commit timestamp of the write
+    char *value; // NULL if the pair was deleted
+    uint64_t expires_at; // Expiration time in milliseconds, 0 if the pair never expires
+    struct Version *older;
+} Version;
 
 typedef struct KeyNode {
     char *key;
-    char *value;
-    struct KeyNode *next;
+    uint64_t hash; // hash_string of the key, used by the bucket index
+    _Atomic(Version *) version; // Newest version first
+    TimerEntry *timer; // Pending expiration in the timing wheel, if any
+    atomic_bool referenced; // CLOCK reference bit, set by readers without taking the write lock
+    bool collect; // Queued in the garbage list of its bucket
+    uint64_t retired_at; // Last commit when the collector unlinked the node
+    struct KeyNode *prev;
+    _Atomic(struct KeyNode *) next; // Followed by snapshots without the bucket lock
+    struct KeyNode *garbage_next; // Next node in the garbage or retired list
 } KeyNode;
 
+// Key deleted since the last backup.
+typedef struct Tombstone {
+    struct Tombstone *next;
+    uint64_t ts; // Commit timestamp of the delete
+    char key[];
+} Tombstone;
+
+// Consistent view of the table as of a commit. Open snapshots are kept oldest
+// first, so the first one bounds what the collector may free.
+typedef struct Snapshot {
+    uint64_t ts; // Commits up to this timestamp are visible
+    uint64_t now_ms; // Time pairs are expired against
+    struct Snapshot *prev;
+    struct Snapshot *next;
+} Snapshot;
+
 typedef struct HashTable {
-    KeyNode *table[TABLE_SIZE];
+    _Atomic(KeyNode *) table[TABLE_SIZE]; // Nodes of each bucket, newest first
+    GroupIndex index[TABLE_SIZE]; // Lookup index of each bucket
+    BloomFilter filters[TABLE_SIZE]; // Keys of each bucket, so most misses skip the index
+    Tombstone *tombstones[TABLE_SIZE]; // Keys of each bucket deleted since the last backup, newest first
+    _Atomic(uint64_t) changed_at[TABLE_SIZE]; // Commit timestamp of the last change of each bucket
+    atomic_bool track_changes; // Whether deletes leave tombstones (once a backup exists)
+    KeyNode *garbage[TABLE_SIZE]; // Nodes with old versions or a delete to be collected
+    KeyNode *retired[TABLE_SIZE]; // Unlinked nodes, freed once older snapshots are closed
+    atomic_uint garbage_buckets; // Bit i is set if bucket i has garbage or retired nodes
+    pthread_rwlock_t locks[TABLE_SIZE];
+    _Atomic(uint64_t) commit_ts; // Timestamp of the last commit
+    pthread_rwlock_t commit_gate; // Held shared by commits, exclusively to open a snapshot
+    pthread_mutex_t snapshot_lock;
+    Snapshot *snapshots; // Open snapshots, oldest first
+    Snapshot *newest_snapshot;
+    atomic_size_t open_snapshots;
+    TimerWheel wheel;
+    InternTable *intern; // Shared values, NULL if values are not interned
+    HotKeys *hot; // Most read keys and the stamps of the read caches
+    size_t memory_limit; // 0 if the table may grow without bound
+    int lookup_bypass; // LOOKUP_BYPASS_* parts of the lookup path that are skipped
+    atomic_size_t memory_used; // Bytes of keys, values, versions and nodes, and of the indexes, filters and tombstones of the buckets
+    atomic_size_t pairs;
+    atomic_size_t evictions;
+    atomic_size_t expirations;
+    atomic_size_t stale_versions; // Versions kept for snapshots, not yet collected
+    pthread_mutex_t clock_lock;
+    int clock_hand; // Next bucket swept by the CLOCK eviction
 } HashTable;
 
+typedef struct TableStats {
+    size_t pairs;
+    size_t memory_used;
+    size_t memory_limit;
+    size_t evictions;
+    size_t expirations;
+    size_t interned_values; // Distinct values shared by the pairs
+    size_t stale_versions;
+} TableStats;
+
+/// Bucket of a key, from its first character.
+/// @param key Key of a pair.
+/// @return Index of the bucket, -1 if the key does not start with a letter or digit.
+int hash(const char *key);
+
 /// Creates a new event hash table.
+/// @param memory_limit Maximum bytes used by the table, 0 for no limit.
+/// @param intern_values Whether equal values share a single allocation.
+/// @param lookup_bypass LOOKUP_BYPASS_* parts of the lookup path to skip, 0 to use all of them.
 /// @return Newly created hash table, NULL on failure
-struct HashTable *create_hash_table();
+struct HashTable *create_hash_table(size_t memory_limit, int intern_values, int lookup_bypass);
 
 /// Appends a new key value pair to the hash table.
 /// @param ht Hash table to be modified.
 /// @param key Key of the pair to be written.
 /// @param value Value of the pair to be written.
+/// @param ttl_ms Time to live of the pair in milliseconds, 0 if it never expires.
 /// @return 0 if the node was appended successfully, 1 otherwise.
-int write_pair(HashTable *ht, const char *key, const char *value);
+int write_pair(HashTable *ht, const char *key, const char *value, unsigned int ttl_ms);
+
+/// Builds the node of a pair without taking any lock, to be linked with splice_nodes.
+/// @param ht Hash table the node is for.
+/// @param key Key of the pair.
+/// @param value Value of the pair.
+/// @param h hash_string of the key.
+/// @param expires_at Expiration time in milliseconds, 0 if the pair never expires.
+/// @return The node, NULL on failure.
+KeyNode *prepare_node(HashTable *ht, const char *key, const char *value, uint64_t h, uint64_t expires_at);
+
+/// Links prepared nodes of a bucket, in order, under a single acquisition of
+/// its lock. Nodes whose key is already in the table update it instead and
+/// are freed. Expiration timers are not scheduled, so the nodes must not expire.
+/// @param ht Hash table to be modified.
+/// @param index Bucket of the nodes.
+/// @param nodes Nodes built with prepare_node.
+/// @param count Number of nodes.
+/// @return Number of pairs written.
+size_t splice_nodes(HashTable *ht, int index, KeyNode **nodes, size_t count);
+
+/// Evicts cold pairs while the table is above its memory limit.
+/// @param ht Hash table to trim.
+void enforce_memory_limit(HashTable *ht);
 
-/// Deletes the value of given key.
-/// @param ht Hash table to delete from.
-/// @param key Key of the pair to be deleted.
-/// @return 0 if the node was deleted successfully, 1 otherwise.
-char* read_pair(HashTable *ht, const char *key);
+/// Reads the value of given key.
+/// @param ht Hash table to read from.
+/// @param key Key of the pair to read.
+/// @param snapshot Snapshot to read at, NULL to read the latest value.
+/// @return Copy of the value, NULL if the pair does not exist (or has expired).
+char* read_pair(HashTable *ht, const char *key, const Snapshot *snapshot);
 
 /// Appends a new node to the list.
 /// @param list Event list to be modified.
@@ -38,6 +154,77 @@ char* read_pair(HashTable *ht, const char *key);
 /// @return 0 if the node was appended successfully, 1 otherwise.
 int delete_pair(HashTable *ht, const char *key);
 
+/// Checks if a key has a node in its bucket, even one whose pair was deleted
+/// or has expired, in which case writing the key updates the node instead of
+/// linking a new one. Does not count as a read.
+/// @param ht Hash table to search.
+/// @param key Key to be searched for.
+/// @return 1 if the key has a node, 0 otherwise.
+int has_node(HashTable *ht, const char *key);
+
+/// Opens a snapshot of the table. Until it is closed, writers keep the
+/// versions it reads instead of overwriting them.
+/// @param ht Hash table to snapshot.
+/// @param snapshot Snapshot to be opened.
+void snapshot_open(HashTable *ht, Snapshot *snapshot);
+
+/// Closes a snapshot, so the versions only it could read can be collected.
+/// @param ht Hash table of the snapshot.
+/// @param snapshot Snapshot to be closed.
+void snapshot_close(HashTable *ht, Snapshot *snapshot);
+
+/// Finds the version of a node that was the newest as of a commit, including deletes.
+/// @param keyNode Node of the pair.
+/// @param ts Commit timestamp.
+/// @return The version, NULL if the node was created after the commit.
+const Version *version_at(const KeyNode *keyNode, uint64_t ts);
+
+/// Checks if a version has expired (and should be hidden from readers).
+/// @param version Version of the pair.
+/// @param now_ms Current time in milliseconds.
+/// @return 1 if the version has expired, 0 otherwise.
+int version_expired(const Version *version, uint64_t now_ms);
+
+/// Finds the value of a node seen by a snapshot. Nodes may be followed from
+/// HashTable->table without the bucket lock while the snapshot is open.
+/// @param keyNode Node of the pair.
+/// @param snapshot Open snapshot.
+/// @return The version, NULL if the pair did not exist, was deleted or has expired.
+const Version *snapshot_version(const KeyNode *keyNode, const Snapshot *snapshot);
+
+/// Frees the versions and deleted nodes no open snapshot can read anymore.
+/// @param ht Hash table to collect.
+/// @return Number of versions and nodes freed.
+size_t collect_garbage(HashTable *ht);
+
+/// Detaches the tombstones of a bucket up to a commit.
+/// @param ht Hash table.
+/// @param index Bucket.
+/// @param ts Commit timestamp.
+/// @return List of the tombstones, to be freed with free_tombstones.
+Tombstone *take_tombstones(HashTable *ht, int index, uint64_t ts);
+
+/// Advances the expiration wheel and deletes the pairs that expired.
+/// @param ht Hash table to reap.
+/// @return Number of pairs deleted.
+size_t reap_expired(HashTable *ht);
+
+/// Frees a list of tombstones.
+/// @param ht Hash table the tombstones were taken from.
+/// @param tombstone First tombstone of the list.
+void free_tombstones(HashTable *ht, Tombstone *tombstone);
+
+/// Reads the counters of the hash table.
+/// @param ht Hash table to inspect.
+/// @param stats Where to store the counters.
+void table_stats(HashTable *ht, TableStats *stats);
+
+/// Frees the pairs, index and tombstones of a bucket. Buckets may be cleared
+/// in parallel, but only once no other thread uses the table.
+/// @param ht Hash table.
+/// @param index Bucket to be cleared.
+void clear_bucket(HashTable *ht, int index);
+
 /// Frees the hashtable.
 /// @param ht Hash table to be deleted.
 void free_table(HashTable *ht);
@@ -0,0 +1,298 @@
+#include "load.h"
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "hash.h"
+
+// Record of the file, pointing into the mapping.
+typedef struct LoadRecord {
+  const char *key;
+  const char *value;
+  uint64_t hash;
+  uint8_t key_len;
+  uint8_t value_len;
+} LoadRecord;
+
+typedef struct LoadPartition {
+  LoadRecord *records;
+  size_t count;
+  size_t capacity;
+} LoadPartition;
+
+// Byte range of the file, with its records split by bucket.
+typedef struct LoadChunk {
+  const char *start;
+  const char *end;
+  LoadPartition partitions[TABLE_SIZE];
+  size_t skipped;
+} LoadChunk;
+
+typedef struct LoadJob {
+  HashTable *ht;
+  bool binary;
+  LoadChunk *chunks;
+  size_t num_chunks;
+  atomic_size_t loaded;
+  atomic_size_t skipped;
+} LoadJob;
+
+// Checks a key or value can be written and read back by the other commands.
+static bool valid_field(const char *field, size_t len) {
+  if (len == 0 || len >= MAX_STRING_SIZE) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (strchr(" ,()[]\t\r\n", field[i]) != NULL) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Hashes a record into the partition of its bucket.
+static void add_record(LoadChunk *chunk, const char *key, size_t key_len, const char *value, size_t value_len) {
+  int index = valid_field(key, key_len) && valid_field(value, value_len) ? hash(key) : -1;
+  if (index < 0) {
+    chunk->skipped++;
+    return;
+  }
+
+  LoadPartition *partition = &chunk->partitions[index];
+  if (partition->count == partition->capacity) {
+    size_t capacity = partition->capacity != 0 ? 2 * partition->capacity : 64;
+    LoadRecord *records = realloc(partition->records, capacity * sizeof(LoadRecord));
+    if (records == NULL) {
+      chunk->skipped++;
+      return;
+    }
+    partition->records = records;
+    partition->capacity = capacity;
+  }
+
+  partition->records[partition->count++] = (LoadRecord){
+      .key = key,
+      .value = value,
+      .hash = hash_bytes(key, key_len),
+      .key_len = (uint8_t)key_len,
+      .value_len = (uint8_t)value_len,
+  };
+}
+
+static void parse_text_chunk(LoadChunk *chunk) {
+  const char *line = chunk->start;
+  while (line < chunk->end) {
+    const char *newline = memchr(line, '\n', (size_t)(chunk->end - line));
+    const char *line_end = newline != NULL ? newline : chunk->end;
+    const char *next = newline != NULL ? newline + 1 : chunk->end;
+    if (line_end > line && line_end[-1] == '\r') {
+      line_end--;
+    }
+
+    if (line_end > line && *line != '#') {
+      const char *comma = memchr(line, ',', (size_t)(line_end - line));
+      if (comma == NULL) {
+        chunk->skipped++;
+      } else {
+        add_record(chunk, line, (size_t)(comma - line), comma + 1, (size_t)(line_end - comma - 1));
+      }
+    }
+    line = next;
+  }
+}
+
+static void parse_binary_chunk(LoadChunk *chunk) {
+  const unsigned char *cursor = (const unsigned char *)chunk->start;
+  const unsigned char *end = (const unsigned char *)chunk->end;
+  while (cursor < end) {
+    size_t key_len = cursor[0];
+    const unsigned char *value_len = cursor + 1 + key_len;
+    if (value_len >= end || value_len + 1 + *value_len > end) {
+      chunk->skipped++; // Truncated record at the end of the file
+      return;
+    }
+    add_record(chunk, (const char *)cursor + 1, key_len, (const char *)value_len + 1, *value_len);
+    cursor = value_len + 1 + *value_len;
+  }
+}
+
+// First stage: parse a chunk and partition its records by bucket.
+static void partition_chunk(void *arg, size_t task) {
+  LoadJob *job = arg;
+  LoadChunk *chunk = &job->chunks[task];
+  if (job->binary) {
+    parse_binary_chunk(chunk);
+  } else {
+    parse_text_chunk(chunk);
+  }
+}
+
+// Second stage: build the nodes of a bucket without locks, in file order, and splice them.
+static void build_bucket(void *arg, size_t task) {
+  LoadJob *job = arg;
+  int index = (int)task;
+
+  size_t count = 0;
+  for (size_t c = 0; c < job->num_chunks; c++) {
+    count += job->chunks[c].partitions[index].count;
+  }
+  if (count == 0) {
+    return;
+  }
+
+  KeyNode **nodes = malloc(count * sizeof(KeyNode *));
+  if (nodes == NULL) {
+    atomic_fetch_add(&job->skipped, count);
+    return;
+  }
+
+  size_t built = 0;
+  char key[MAX_STRING_SIZE];
+  char value[MAX_STRING_SIZE];
+  for (size_t c = 0; c < job->num_chunks; c++) {
+    const LoadPartition *partition = &job->chunks[c].partitions[index];
+    for (size_t i = 0; i < partition->count; i++) {
+      const LoadRecord *record = &partition->records[i];
+      memcpy(key, record->key, record->key_len);
+      key[record->key_len] = '\0';
+      memcpy(value, record->value, record->value_len);
+      value[record->value_len] = '\0';
+
+      KeyNode *keyNode = prepare_node(job->ht, key, value, record->hash, 0);
+      if (keyNode != NULL) {
+        nodes[built++] = keyNode;
+      }
+    }
+  }
+
+  size_t spliced = splice_nodes(job->ht, index, nodes, built);
+  atomic_fetch_add(&job->loaded, spliced);
+  atomic_fetch_add(&job->skipped, count - spliced);
+  free(nodes);
+}
+
+// Splits text at line starts, so every chunk holds whole lines.
+static void split_text(LoadJob *job, const char *data, size_t size) {
+  const char *end = data + size;
+  const char *start = data;
+  for (size_t c = 0; c < job->num_chunks; c++) {
+    const char *chunk_end = end;
+    if (c + 1 < job->num_chunks) {
+      chunk_end = data + size / job->num_chunks * (c + 1);
+      if (chunk_end < start) {
+        chunk_end = start;
+      }
+      const char *newline = memchr(chunk_end, '\n', (size_t)(end - chunk_end));
+      chunk_end = newline != NULL ? newline + 1 : end;
+    }
+    job->chunks[c].start = start;
+    job->chunks[c].end = chunk_end;
+    start = chunk_end;
+  }
+}
+
+// Splits binary records at record starts. Only the length bytes are read here.
+static void split_binary(LoadJob *job, const char *data, size_t size) {
+  const unsigned char *cursor = (const unsigned char *)data + LOAD_BINARY_MAGIC_SIZE;
+  const unsigned char *end = (const unsigned char *)data + size;
+  size_t target = (size - LOAD_BINARY_MAGIC_SIZE) / job->num_chunks;
+
+  for (size_t c = 0; c < job->num_chunks; c++) {
+    const unsigned char *start = cursor;
+    if (c + 1 < job->num_chunks) {
+      while (cursor < end && (size_t)(cursor - start) < target) {
+        const unsigned char *value_len = cursor + 1 + cursor[0];
+        if (value_len >= end) {
+          cursor = end;
+          break;
+        }
+        cursor = value_len + 1 + *value_len;
+      }
+      if (cursor > end) {
+        cursor = end;
+      }
+    } else {
+      cursor = end;
+    }
+    job->chunks[c].start = (const char *)start;
+    job->chunks[c].end = (const char *)cursor;
+  }
+}
+
+int load_file(HashTable *ht, WorkerPool *pool, const char *path, LoadStats *stats) {
+  stats->loaded = 0;
+  stats->skipped = 0;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror("Failed to open load file");
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    perror("Failed to stat load file");
+    close(fd);
+    return 1;
+  }
+  size_t size = (size_t)st.st_size;
+  if (size == 0) {
+    close(fd);
+    return 0;
+  }
+
+  const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror("Failed to map load file");
+    return 1;
+  }
+
+  LoadJob job;
+  job.ht = ht;
+  job.binary = size >= LOAD_BINARY_MAGIC_SIZE && memcmp(data, LOAD_BINARY_MAGIC, LOAD_BINARY_MAGIC_SIZE) == 0;
+  job.num_chunks = size / LOAD_MIN_CHUNK_SIZE + 1;
+  if (job.num_chunks > 4 * worker_pool_width(pool)) {
+    job.num_chunks = 4 * worker_pool_width(pool); // A few chunks per thread even out their lengths
+  }
+  atomic_init(&job.loaded, 0);
+  atomic_init(&job.skipped, 0);
+  job.chunks = calloc(job.num_chunks, sizeof(LoadChunk));
+  if (job.chunks == NULL) {
+    perror("Failed to allocate load chunks");
+    munmap((void *)data, size);
+    return 1;
+  }
+
+  if (job.binary) {
+    split_binary(&job, data, size);
+  } else {
+    split_text(&job, data, size);
+  }
+
+  worker_pool_run(pool, job.num_chunks, partition_chunk, &job);
+  worker_pool_run(pool, TABLE_SIZE, build_bucket, &job);
+
+  for (size_t c = 0; c < job.num_chunks; c++) {
+    atomic_fetch_add(&job.skipped, job.chunks[c].skipped);
+    for (int i = 0; i < TABLE_SIZE; i++) {
+      free(job.chunks[c].partitions[i].records);
+    }
+  }
+  free(job.chunks);
+  munmap((void *)data, size);
+
+  enforce_memory_limit(ht);
+  stats->loaded = atomic_load(&job.loaded);
+  stats->skipped = atomic_load(&job.skipped);
+  return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef KVS_LOAD_H
+#define KVS_LOAD_H
+
+#include <stddef.h>
+
+#include "kvs.h"
+#include "workers.h"
+
+// Binary files start with this magic, followed by records made of a key
+// length byte, the key, a value length byte and the value. Any other file is
+// read as text, one key,value pair per line ('#' starts a comment line).
+#define LOAD_BINARY_MAGIC "KVSLOAD\n"
+#define LOAD_BINARY_MAGIC_SIZE 8
+
+// Smallest chunk worth handing to a thread of its own.
+#define LOAD_MIN_CHUNK_SIZE (64 * 1024)
+
+typedef struct LoadStats {
+  size_t loaded;    // Pairs written
+  size_t skipped;   // Records that were malformed or could not be written
+} LoadStats;
+
+/// Loads the pairs of a file into the table. The file is split into chunks
+/// that are parsed, hashed and partitioned by bucket in parallel; each
+/// bucket is then built without locks and spliced into the table under a
+/// single acquisition of its lock. Later records of a key overwrite earlier ones.
+/// @param ht Hash table to load into.
+/// @param pool Pool to run the chunks and buckets on.
+/// @param path Path of the file.
+/// @param stats Where to store the number of pairs loaded and skipped.
+/// @return 0 if the file was read successfully, 1 otherwise.
+int load_file(HashTable *ht, WorkerPool *pool, const char *path, LoadStats *stats);
+
+#endif  // KVS_LOAD_H
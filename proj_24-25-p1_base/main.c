@@ -3,111 +3,52 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include "command.h"
+#include "config.h"
 #include "constants.h"
 #include "parser.h"
 #include "operations.h"
+#include "watch.h"
 
-int main() {
-  if (kvs_init()) {
+int main(int argc, char *argv[]) {
+  KvsConfig config;
+  if (parse_config(argc, argv, &config)) {
+    return 1;
+  }
+
+  if (kvs_init(&config)) {
     fprintf(stderr, "Failed to initialize KVS\n");
     return 1;
   }
 
-  while (1) {
-    char keys[MAX_WRITE_SIZE][MAX_STRING_SIZE] = {0};
-    char values[MAX_WRITE_SIZE][MAX_STRING_SIZE] = {0};
-    unsigned int delay;
-    size_t num_pairs;
+  // Backups from the prompt are named kvs-<n>.bck
+  CommandContext context;
+  command_context_init(&context, "kvs", 3);
+
+  CommandRecord *record = malloc(sizeof(CommandRecord));
+  if (record == NULL) {
+    perror("Failed to allocate command record");
+    kvs_terminate();
+    return 1;
+  }
 
+  while (1) {
     printf("> ");
     fflush(stdout);
 
-    switch (get_next(STDIN_FILENO)) {
-      case CMD_WRITE:
-        num_pairs = parse_write(STDIN_FILENO, keys, values, MAX_WRITE_SIZE, MAX_STRING_SIZE);
-        if (num_pairs == 0) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          continue;
-        }
-
-        if (kvs_write(num_pairs, keys, values)) {
-          fprintf(stderr, "Failed to write pair\n");
-        }
-
-        break;
-
-      case CMD_READ:
-        num_pairs = parse_read_delete(STDIN_FILENO, keys, MAX_WRITE_SIZE, MAX_STRING_SIZE);
-
-        if (num_pairs == 0) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          continue;
-        }
-
-        if (kvs_read(num_pairs, keys)) {
-          fprintf(stderr, "Failed to read pair\n");
-        }
-        break;
-
-      case CMD_DELETE:
-        num_pairs = parse_read_delete(STDIN_FILENO, keys, MAX_WRITE_SIZE, MAX_STRING_SIZE);
-
-        if (num_pairs == 0) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          continue;
-        }
-
-        if (kvs_delete(num_pairs, keys)) {
-          fprintf(stderr, "Failed to delete pair\n");
-        }
-        break;
-
-      case CMD_SHOW:
-
-        kvs_show();
-        break;
-
-      case CMD_WAIT:
-        if (parse_wait(STDIN_FILENO, &delay, NULL) == -1) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          continue;
-        }
-
-        if (delay > 0) {
-          printf("Waiting...\n");
-          kvs_wait(delay);
-        }
-        break;
-
-      case CMD_BACKUP:
-
-        if (kvs_backup()) {
-          fprintf(stderr, "Failed to perform backup.\n");
-        }
+    // Paths are read with the same descriptor as the commands, so no input is buffered away from them
+    parse_command(STDIN_FILENO, record);
+    switch (record->cmd) {
+      case CMD_OPENDIR:
+        kvs_process_directory(record->path);
         break;
 
-      case CMD_INVALID:
-        fprintf(stderr, "Invalid command. See HELP for usage\n");
+      case CMD_WATCH:
+        kvs_watch_directory(record->path);
         break;
-
-      case CMD_OPENDIR:
-        {
-                    char directory_path[MAX_JOB_FILE_NAME_SIZE];
-                    if (fgets(directory_path, sizeof(directory_path), stdin) != NULL) {
-                        // Remove newline character if present
-                        size_t len = strlen(directory_path);
-                        if (len > 0 && directory_path[len - 1] == '\n') {
-                            directory_path[len - 1] = '\0';
-                        }
-
-                        kvs_process_directory(directory_path);
-                    } else {
-                        fprintf(stderr, "Failed to read directory path\n");
-                    }
-                }
-                break;
       
       case CMD_QUIT: 
+            free(record);
             kvs_terminate();
             printf("Exiting program.\n");
             return 0;
@@ -115,25 +56,41 @@ int main() {
       case CMD_HELP:
         printf( 
             "Available commands:\n"
-            "  WRITE [(key,value)(key2,value2),...]\n"
+            "  WRITE [(key,value[,ttl_ms])(key2,value2),...]\n"
             "  READ [key,key2,...]\n"
             "  DELETE [key,key2,...]\n"
             "  SHOW\n"
+            "  STATS\n"
+            "  HOTKEYS\n"
             "  WAIT <delay_ms>\n"
-            "  BACKUP\n" // Not implemented
+            "  BACKUP\n"
+            "  LOAD <file>\n"
             "  OPENDIR <directory_path>\n"
+            "  WATCH <directory_path>\n"
             "  QUIT\n"
             "  HELP\n"
         );
 
         break;
         
-      case CMD_EMPTY:
-        break;
-
       case EOC:
+        free(record);
         kvs_terminate();
         return 0;
+
+      case CMD_WRITE:
+      case CMD_READ:
+      case CMD_DELETE:
+      case CMD_SHOW:
+      case CMD_STATS:
+      case CMD_HOTKEYS:
+      case CMD_WAIT:
+      case CMD_BACKUP:
+      case CMD_LOAD:
+      case CMD_INVALID:
+      case CMD_EMPTY:
+        execute_command(record, &context);
+        break;
     }
   }
 }
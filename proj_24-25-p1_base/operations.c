@@ -1,17 +1,43 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <ctype.h>
+#include "affinity.h"
+#include "jobgraph.h"
+#include "jobio.h"
 #include "kvs.h"
+#include "load.h"
+#include "backup.h"
+#include "command.h"
 #include "constants.h"
 #include "parser.h"
 #include "operations.h"
+#include "pipeline.h"
+#include "trace.h"
+#include "workers.h"
 
 static struct HashTable* kvs_table = NULL;
+static BackupChain backup_chain;
+static pthread_t reaper_thread;
+static atomic_bool reaper_running = false;
+static int pipelined_jobs = 0;
+static CommandGraph *command_graph = NULL;  // Window of -g shared by every job, NULL without -g
+static WorkerPool worker_pool;
+static CpuSet backup_cpus;
+static WorkerPool backup_pool;        // Workers of backups, pinned to the backup CPUs
+static bool backup_pool_started = false;
+static JobIO job_io;
+static _Thread_local FILE *command_output = NULL; // NULL for stdout
+static _Thread_local int read_snapshots = 1;     // Whether READ batches open a snapshot
+static pthread_mutex_t backup_lock = PTHREAD_MUTEX_INITIALIZER; // Backups of every job share the chain
 
 
 /// Calculates a timespec from a delay in milliseconds.
@@ -21,14 +47,122 @@ static struct timespec delay_to_timespec(unsigned int delay_ms) {
   return (struct timespec){delay_ms / 1000, (delay_ms % 1000) * 1000000};
 }
 
-int kvs_init() {
+/// Background thread that deletes expired pairs, one wheel tick at a time,
+/// and collects the versions no snapshot reads anymore.
+static void *expiration_reaper(void *arg) {
+  (void)arg;
+  struct timespec tick = delay_to_timespec(TTL_TICK_MS);
+
+  while (atomic_load(&reaper_running)) {
+    nanosleep(&tick, NULL);
+    reap_expired(kvs_table);
+    collect_garbage(kvs_table);
+  }
+
+  return NULL;
+}
+
+// Writes where the job thread, the workers and the backups run, if they were pinned.
+static void report_placement(const KvsConfig *config, int job_cpu) {
+  if (!cpu_set_empty(&config->job_cpus)) {
+    if (job_cpu >= 0) {
+      fprintf(stderr, "Job thread on CPU %d (node %d)\n", job_cpu, cpu_node(job_cpu));
+    } else {
+      fprintf(stderr, "Job thread unpinned\n");
+    }
+    for (size_t i = 0; i < worker_pool.num_threads; i++) {
+      if (worker_pool.cpus[i] >= 0) {
+        fprintf(stderr, "Worker %zu on CPU %d (node %d)\n", i + 1, worker_pool.cpus[i], cpu_node(worker_pool.cpus[i]));
+      } else {
+        fprintf(stderr, "Worker %zu unpinned\n", i + 1);
+      }
+    }
+  }
+
+  if (!cpu_set_empty(&backup_cpus)) {
+    char list[256];
+    cpu_set_format(&backup_cpus, list, sizeof(list));
+    int node = cpu_node(cpu_set_nth(&backup_cpus, 0));
+    fprintf(stderr, "Backups on CPUs %s (node %d) with %zu workers\n", list, node, backup_pool.num_threads);
+  }
+}
+
+int kvs_init(const KvsConfig *config) {
   if (kvs_table != NULL) {
     fprintf(stderr, "KVS state has already been initialized\n");
     return 1;
   }
 
-  kvs_table = create_hash_table();
-  return kvs_table == NULL;
+  // Pinned first, so the table is allocated on the node of the job thread
+  int job_cpu = -1;
+  if (!cpu_set_empty(&config->job_cpus)) {
+    job_cpu = cpu_set_nth(&config->job_cpus, 0);
+    if (affinity_pin(pthread_self(), job_cpu) != 0) {
+      fprintf(stderr, "Failed to pin job thread to CPU %d\n", job_cpu);
+      job_cpu = -1;
+    }
+  }
+  backup_cpus = config->backup_cpus;
+  jobio_init(&job_io, config->io_uring_jobs);
+
+  kvs_table = create_hash_table(config->memory_limit, config->intern_values, config->lookup_bypass);
+  if (kvs_table == NULL) {
+    return 1;
+  }
+  backup_chain_init(&backup_chain);
+  pipelined_jobs = config->pipelined_jobs;
+
+  if (worker_pool_init(&worker_pool, config->worker_threads, &config->job_cpus) != 0) {
+    free_table(kvs_table);
+    kvs_table = NULL;
+    return 1;
+  }
+
+  // Backups write their buckets on workers of their own, so they stay on the backup CPUs
+  if (!cpu_set_empty(&backup_cpus)) {
+    size_t backup_threads = cpu_set_count(&backup_cpus) - 1;
+    if (worker_pool_init(&backup_pool, backup_threads < MAX_WORKER_THREADS ? backup_threads : MAX_WORKER_THREADS,
+                         &backup_cpus) != 0) {
+      worker_pool_destroy(&worker_pool);
+      free_table(kvs_table);
+      kvs_table = NULL;
+      return 1;
+    }
+    backup_pool_started = true;
+  }
+
+  atomic_store(&reaper_running, true);
+  if (pthread_create(&reaper_thread, NULL, expiration_reaper, NULL) != 0) {
+    fprintf(stderr, "Failed to start expiration reaper\n");
+    atomic_store(&reaper_running, false);
+    if (backup_pool_started) {
+      worker_pool_destroy(&backup_pool);
+      backup_pool_started = false;
+    }
+    worker_pool_destroy(&worker_pool);
+    free_table(kvs_table);
+    kvs_table = NULL;
+    return 1;
+  }
+
+  // Allocated once, rather than for each job, as many jobs may be small
+  if (config->parallel_commands && worker_pool_width(&worker_pool) > 1 &&
+      (command_graph = jobgraph_create()) == NULL) {
+    fprintf(stderr, "Failed to allocate command graph, jobs run sequentially\n");
+  }
+
+  if (config->trace_path != NULL && trace_open(config->trace_path) != 0) {
+    kvs_terminate();
+    return 1;
+  }
+
+  report_placement(config, job_cpu);
+  return 0;
+}
+
+// Frees the pairs of a bucket at shutdown.
+static void clear_bucket_task(void *arg, size_t task) {
+  clear_bucket(arg, (int)task);
 }
 
 int kvs_terminate() {
@@ -37,19 +171,49 @@ int kvs_terminate() {
     return 1;
   }
 
+  atomic_store(&reaper_running, false);
+  pthread_join(reaper_thread, NULL);
+  trace_close();
+  jobio_destroy(&job_io);
+
+  // The buckets are freed in parallel, as chains of millions of nodes take a while to walk
+  worker_pool_run(&worker_pool, TABLE_SIZE, clear_bucket_task, kvs_table);
+  worker_pool_destroy(&worker_pool);
+  if (backup_pool_started) {
+    worker_pool_destroy(&backup_pool);
+    backup_pool_started = false;
+  }
+  jobgraph_destroy(command_graph);
+  command_graph = NULL;
   free_table(kvs_table);
   kvs_table = NULL;
   return 0;
 }
 
-int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE]) {
+FILE *kvs_output() {
+  return command_output != NULL ? command_output : stdout;
+}
+
+void kvs_set_output(FILE *out) {
+  command_output = out;
+}
+
+void kvs_set_read_snapshots(int enabled) {
+  read_snapshots = enabled;
+}
+
+int kvs_has_key(const char *key) {
+  return has_node(kvs_table, key);
+}
+
+int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], unsigned int ttls[]) {
   if (kvs_table == NULL) {
     fprintf(stderr, "KVS state must be initialized\n");
     return 1;
   }
 
   for (size_t i = 0; i < num_pairs; i++) {
-    if (write_pair(kvs_table, keys[i], values[i]) != 0) {
+    if (write_pair(kvs_table, keys[i], values[i], ttls[i]) != 0) {
       fprintf(stderr, "Failed to write keypair (%s,%s)\n", keys[i], values[i]);
     }
   }
@@ -63,17 +227,29 @@ int kvs_read(size_t num_pairs, char keys[][MAX_STRING_SIZE]) {
     return 1;
   }
 
-  printf("[");
+  // A batch reads every key at the same commit
+  FILE *out = kvs_output();
+  Snapshot snapshot;
+  int batch = num_pairs > 1 && read_snapshots;
+  if (batch) {
+    snapshot_open(kvs_table, &snapshot);
+  }
+
+  fprintf(out, "[");
   for (size_t i = 0; i < num_pairs; i++) {
-    char* result = read_pair(kvs_table, keys[i]);
+    char* result = read_pair(kvs_table, keys[i], batch ? &snapshot : NULL);
     if (result == NULL) {
-      printf("(%s,KVSERROR)", keys[i]);
+      fprintf(out, "(%s,KVSERROR)", keys[i]);
     } else {
-      printf("(%s,%s)", keys[i], result);
+      fprintf(out, "(%s,%s)", keys[i], result);
     }
     free(result);
   }
-  printf("]\n");
+  fprintf(out, "]\n");
+
+  if (batch) {
+    snapshot_close(kvs_table, &snapshot);
+  }
   return 0;
 }
 
@@ -82,199 +258,236 @@ int kvs_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE]) {
     fprintf(stderr, "KVS state must be initialized\n");
     return 1;
   }
+  FILE *out = kvs_output();
   int aux = 0;
 
   for (size_t i = 0; i < num_pairs; i++) {
     if (delete_pair(kvs_table, keys[i]) != 0) {
       if (!aux) {
-        printf("[");
+        fprintf(out, "[");
         aux = 1;
       }
-      printf("(%s,KVSMISSING)", keys[i]);
+      fprintf(out, "(%s,KVSMISSING)", keys[i]);
     }
   }
   if (aux) {
-    printf("]\n");
+    fprintf(out, "]\n");
   }
 
   return 0;
 }
 
-void kvs_show() {
-  for (int i = 0; i < TABLE_SIZE; i++) {
-    KeyNode *keyNode = kvs_table->table[i];
-    while (keyNode != NULL) {
-      printf("(%s, %s)\n", keyNode->key, keyNode->value);
-      keyNode = keyNode->next; // Move to the next node
+// Writes the pairs of a bucket seen by a snapshot.
+static int show_bucket(void *arg, size_t task, FILE *out) {
+  const Snapshot *snapshot = arg;
+  for (KeyNode *keyNode = kvs_table->table[task]; keyNode != NULL; keyNode = keyNode->next) {
+    const Version *version = snapshot_version(keyNode, snapshot);
+    if (version != NULL) {
+      fprintf(out, "(%s, %s)\n", keyNode->key, version->value);
     }
   }
+  return 0;
+}
+
+void kvs_show() {
+  // Read a snapshot, so writers are not blocked and the dump is not torn
+  Snapshot snapshot;
+  snapshot_open(kvs_table, &snapshot);
+  worker_pool_write(&worker_pool, TABLE_SIZE, show_bucket, &snapshot, kvs_output());
+  snapshot_close(kvs_table, &snapshot);
+}
+
+void kvs_stats() {
+  FILE *out = kvs_output();
+  TableStats stats;
+  table_stats(kvs_table, &stats);
+  fprintf(out, "(pairs, %zu)\n", stats.pairs);
+  fprintf(out, "(memory_used, %zu)\n", stats.memory_used);
+  fprintf(out, "(memory_limit, %zu)\n", stats.memory_limit);
+  fprintf(out, "(evictions, %zu)\n", stats.evictions);
+  fprintf(out, "(expirations, %zu)\n", stats.expirations);
+  fprintf(out, "(interned_values, %zu)\n", stats.interned_values);
+  fprintf(out, "(stale_versions, %zu)\n", stats.stale_versions);
+}
+
+void kvs_hotkeys() {
+  FILE *out = kvs_output();
+  HotKey keys[HOT_TOP_KEYS];
+  size_t count = hot_keys_top(kvs_table->hot, keys);
+  for (size_t i = 0; i < count; i++) {
+    // Only one read in HOT_SAMPLE_RATE is counted
+    fprintf(out, "(%s, %zu)\n", keys[i].key, (size_t)keys[i].samples * HOT_SAMPLE_RATE);
+  }
 }
 
-int kvs_backup() {
+int kvs_load(const char *path) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  LoadStats stats;
+  if (load_file(kvs_table, &worker_pool, path, &stats) != 0) {
+    return 1;
+  }
+  if (stats.skipped > 0) {
+    fprintf(stderr, "Skipped %zu invalid records of %s\n", stats.skipped, path);
+  }
   return 0;
 }
 
+int kvs_backup(const char *backup_path) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  // Backups move to their own CPUs for the duration of the write, where their workers are
+  CpuSet previous;
+  bool moved = !cpu_set_empty(&backup_cpus) && affinity_get(pthread_self(), &previous) == 0 &&
+               affinity_set(pthread_self(), &backup_cpus) == 0;
+  pthread_mutex_lock(&backup_lock);
+  int result = backup_write(kvs_table, backup_pool_started ? &backup_pool : &worker_pool, &backup_chain, backup_path);
+  pthread_mutex_unlock(&backup_lock);
+  if (moved) {
+    affinity_set(pthread_self(), &previous);
+  }
+  return result;
+}
+
 void kvs_wait(unsigned int delay_ms) {
   struct timespec delay = delay_to_timespec(delay_ms);
   nanosleep(&delay, NULL);
 }
 
-void process_file(const char *input_path, const char *output_path) {
-    int fd_in = open(input_path, O_RDONLY);
-    if (fd_in < 0) {
-        perror("Failed to open input file");
+// Runs an opened job, buffering its output in memory so it is written in a single request.
+static void run_job(JobInput *input, const char *output_path) {
+    char *output = NULL;
+    size_t output_size = 0;
+    FILE *out = open_memstream(&output, &output_size);
+    if (out == NULL) {
+        perror("Failed to buffer job output");
         return;
     }
 
-    int fd_out = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd_out < 0) {
-        perror("Failed to open output file");
-        close(fd_in);
-        return;
+    // Jobs read in memory are parsed from there, larger ones from their descriptor.
+    // The descriptor may have been read to the end, so it is rewound if it cannot be attached.
+    ParserInput parser_input = {input->data, input->size, 0};
+    if (input->data != NULL && parser_attach(input->fd, &parser_input) != 0 &&
+        lseek(input->fd, 0, SEEK_SET) != 0) {
+        perror("Failed to rewind input file");
     }
-
-  int original_stdout = dup(STDOUT_FILENO);
-    if (original_stdout == -1) {
-        perror("dup");
-        close(fd_in);
-        close(fd_out);
-        return;
+    kvs_set_output(out);
+
+    // Backups of the job are named <job>-<n>.bck
+    CommandContext context;
+    if (command_context_init(&context, output_path, strlen(output_path) - 4) != 0) { // Without ".out"
+        fprintf(stderr, "Path too long: %s\n", output_path);
+    } else if ((command_graph == NULL || jobgraph_run(command_graph, input->fd, &context, &worker_pool) != 0) &&
+               (!pipelined_jobs || pipeline_run(input->fd, &context) != 0)) {
+        CommandRecord *record = malloc(sizeof(CommandRecord));
+        if (record == NULL) {
+            perror("Failed to allocate command record");
+        } else {
+            parse_command(input->fd, record);
+            while (record->cmd != EOC) {
+                execute_command(record, &context);
+                parse_command(input->fd, record);
+            }
+            free(record);
+        }
     }
 
-    // Redirect stdout to the output file descriptor
-    if (dup2(fd_out, STDOUT_FILENO) == -1) {
-        perror("dup2");
-        close(fd_in);
-        close(fd_out);
-        close(original_stdout);
+    kvs_set_output(NULL);
+    parser_detach(input->fd);
+    if (fclose(out) != 0) {
+        perror("Failed to buffer job output");
+        free(output);
         return;
     }
+    jobio_write_output(&job_io, output_path, output, output_size);
+}
 
-    while (1) {
-        int command = get_next(fd_in);
-        if (command == EOC) {
-            break;
-        }
-
-        switch (command) {
-            case CMD_WRITE: {
-                char keys[MAX_WRITE_SIZE][MAX_STRING_SIZE] = {0};
-                char values[MAX_WRITE_SIZE][MAX_STRING_SIZE] = {0};
-                size_t num_pairs = parse_write(fd_in, keys, values, MAX_WRITE_SIZE, MAX_STRING_SIZE);
-                if (num_pairs == 0) {
-                    write(STDERR_FILENO, "Invalid command. See HELP for usage\n", 36);
-                    continue;
-                }
-
-                if (kvs_write(num_pairs, keys, values)) {
-                    write(STDERR_FILENO, "Failed to write pair\n", 21);
-                }
-                break;
-            }
+void trim_whitespace(char *str) {
+    char *start = str;
 
-            case CMD_READ: {
-                char keys[MAX_WRITE_SIZE][MAX_STRING_SIZE] = {0};
-                size_t num_pairs = parse_read_delete(fd_in, keys, MAX_WRITE_SIZE, MAX_STRING_SIZE);
-                if (num_pairs == 0) {
-                    write(STDERR_FILENO, "Invalid command. See HELP for usage\n", 36);
-                    continue;
-                }
-
-                if (kvs_read(num_pairs, keys)) {
-                    write(STDERR_FILENO, "Failed to read pair\n", 20);
-                }
-                break;
-            }
+    // Find the first non-whitespace character
+    while (isspace((unsigned char)*start)) {
+        start++;
+    }
 
-            case CMD_DELETE: {
-                char keys[MAX_WRITE_SIZE][MAX_STRING_SIZE] = {0};
-                size_t num_pairs = parse_read_delete(fd_in, keys, MAX_WRITE_SIZE, MAX_STRING_SIZE);
-                if (num_pairs == 0) {
-                    write(STDERR_FILENO, "Invalid command. See HELP for usage\n", 36);
-                    continue;
-                }
-
-                if (kvs_delete(num_pairs, keys)) {
-                    write(STDERR_FILENO, "Failed to delete pair\n", 22);
-                }
-                break;
-            }
+    // Shift the string to the left
+    if (start != str) {
+        memmove(str, start, strlen(start) + 1);
+    }
+}
 
-            case CMD_SHOW:
-                kvs_show();
-                break;
+int kvs_join_path(const char *directory_path, const char *name, char *path, size_t size) {
+    size_t dir_len = strlen(directory_path);
+    const char *separator = dir_len > 0 && directory_path[dir_len - 1] == '/' ? "" : "/";
+    int len = snprintf(path, size, "%s%s%s", directory_path, separator, name);
+    if (len < 0 || (size_t)len >= size) {
+        fprintf(stderr, "Path too long: %s%s%s\n", directory_path, separator, name);
+        return 1;
+    }
+    return 0;
+}
 
-            case CMD_WAIT: {
-                unsigned int delay;
-                if (parse_wait(fd_in, &delay, NULL) == -1) {
-                    write(STDERR_FILENO, "Invalid command. See HELP for usage\n", 36);
-                    continue;
-                }
-
-                if (delay > 0) {
-                    printf("Waiting...\n");
-                    kvs_wait(delay);
-                }
-                break;
-            }
-            case CMD_BACKUP:
-                if (kvs_backup()) {
-                    write(STDERR_FILENO, "Failed to perform backup.\n", 26);
-                }
-                break;
+int kvs_is_job(const char *path) {
+    size_t len = strlen(path);
+    return len > 4 && strcmp(path + len - 4, ".job") == 0;
+}
 
-            case CMD_INVALID:
-                write(STDERR_FILENO, "Invalid command. See HELP for usage\n", 36);
-                break;
+// Checks if the output of a job is newer than the job itself.
+static int output_up_to_date(const char *input_path, const char *output_path) {
+    struct stat input_stat;
+    struct stat output_stat;
+    if (stat(input_path, &input_stat) != 0 || stat(output_path, &output_stat) != 0) {
+        return 0;
+    }
 
-            case CMD_HELP:
-                printf(
-                    "Available commands:\n"
-                    "  WRITE [(key,value)(key2,value2),...]\n"
-                    "  READ [key,key2,...]\n"
-                    "  DELETE [key,key2,...]\n"
-                    "  SHOW\n"
-                    "  WAIT <delay_ms>\n"
-                    "  BACKUP\n"
-                    "  HELP\n"
-                );
-                break;
-            
-            case EOC:
-            case CMD_EMPTY:
-            case CMD_OPENDIR:
-            case CMD_QUIT:
-                // These commands are not relevant in the context of process_file
-                break;
+    if (output_stat.st_mtim.tv_sec != input_stat.st_mtim.tv_sec) {
+        return output_stat.st_mtim.tv_sec > input_stat.st_mtim.tv_sec;
+    }
+    return output_stat.st_mtim.tv_nsec >= input_stat.st_mtim.tv_nsec;
+}
 
-            default:
-                write(STDERR_FILENO, "Invalid command. See HELP for usage\n", 36);
-                break;
+// Derives the path of the output of a job, the .out file next to it.
+// @return 0 if the job path is valid, 1 otherwise.
+static int job_output_path(const char *input_path, char *output_path) {
+    size_t input_len = strlen(input_path);
 
+    if (!kvs_is_job(input_path)) {
+        fprintf(stderr, "File does not end with .job: %s\n", input_path);
+        return 1;
     }
-  }
-  // Restore the original stdout
-    if (dup2(original_stdout, STDOUT_FILENO) == -1) {
-        perror("dup2");
+
+    if (input_len >= MAX_JOB_FILE_NAME_SIZE) {
+        fprintf(stderr, "Path too long: %s\n", input_path);
+        return 1;
     }
-    close(original_stdout);
 
-    close(fd_in);
-    close(fd_out);
+    strcpy(output_path, input_path);
+    strcpy(output_path + input_len - 4, ".out");
+    return 0;
 }
 
-void trim_whitespace(char *str) {
-    char *start = str;
+void kvs_process_job(const char *input_path, int skip_up_to_date) {
+    char output_path[MAX_JOB_FILE_NAME_SIZE];
+    if (job_output_path(input_path, output_path) != 0) {
+        return;
+    }
 
-    // Find the first non-whitespace character
-    while (isspace((unsigned char)*start)) {
-        start++;
+    if (skip_up_to_date && output_up_to_date(input_path, output_path)) {
+        return;
     }
 
-    // Shift the string to the left
-    if (start != str) {
-        memmove(str, start, strlen(start) + 1);
+    JobInput input;
+    if (jobio_open_input(&job_io, input_path, &input) == 0 && jobio_wait_input(&job_io, &input) == 0) {
+        run_job(&input, output_path);
     }
+    jobio_close_input(&job_io, &input);
+    jobio_flush(&job_io);
 }
 
 void kvs_process_directory(const char *directory_path) {
@@ -289,40 +502,46 @@ void kvs_process_directory(const char *directory_path) {
         return;
     }
 
+    // Jobs are listed first, so the next ones can be read while one runs
+    char (*jobs)[MAX_JOB_FILE_NAME_SIZE] = NULL;
+    size_t num_jobs = 0;
+    size_t capacity = 0;
     struct dirent *entry;
     while ((entry = readdir(dir)) != NULL) {
-        if (strstr(entry->d_name, ".job")) {
-            char input_path[MAX_JOB_FILE_NAME_SIZE];
-            char output_path[MAX_JOB_FILE_NAME_SIZE];
-
-            size_t dir_len = strlen(directory_path);
-            size_t name_len = strlen(entry->d_name);
-
-            if (dir_len + 1 + name_len >= MAX_JOB_FILE_NAME_SIZE) {
-                fprintf(stderr, "Path too long: %s/%s\n", directory_path, entry->d_name);
-                continue;
-            }
-
-            strcpy(input_path, trimmed_path);
-            strcat(input_path, entry->d_name);
+        if (!kvs_is_job(entry->d_name)) {
+            continue;
+        }
 
-            if (dir_len + 1 + name_len + 4 >= MAX_JOB_FILE_NAME_SIZE) { // 4 for ".out"
-                fprintf(stderr, "Path too long: %s/%s.out\n", directory_path, entry->d_name);
-                continue;
+        if (num_jobs == capacity) {
+            capacity = capacity != 0 ? 2 * capacity : 64;
+            char (*grown)[MAX_JOB_FILE_NAME_SIZE] = realloc(jobs, capacity * MAX_JOB_FILE_NAME_SIZE);
+            if (grown == NULL) {
+                perror("Failed to list jobs");
+                break;
             }
+            jobs = grown;
+        }
+        if (kvs_join_path(trimmed_path, entry->d_name, jobs[num_jobs], MAX_JOB_FILE_NAME_SIZE) == 0) {
+            num_jobs++;
+        }
+    }
+    closedir(dir);
 
-            strcpy(output_path, input_path);
-            size_t input_len = strlen(input_path);
-            if (input_len >= 4 && strcmp(input_path + input_len - 4, ".job") == 0) {
-                strcpy(output_path + input_len - 4, ".out");
-            } else {
-                fprintf(stderr, "File does not end with .job: %s\n", input_path);
-                continue;
-            }
+    // Up to JOB_PREFETCH_DEPTH jobs are opened (and read, with io_uring) ahead of the one running
+    JobInput inputs[JOB_PREFETCH_DEPTH];
+    size_t opened = 0;
+    for (size_t i = 0; i < num_jobs; i++) {
+        for (; opened < num_jobs && opened < i + JOB_PREFETCH_DEPTH; opened++) {
+            jobio_open_input(&job_io, jobs[opened], &inputs[opened % JOB_PREFETCH_DEPTH]);
+        }
 
-            process_file(input_path, output_path);
+        JobInput *input = &inputs[i % JOB_PREFETCH_DEPTH];
+        char output_path[MAX_JOB_FILE_NAME_SIZE];
+        if (job_output_path(jobs[i], output_path) == 0 && jobio_wait_input(&job_io, input) == 0) {
+            run_job(input, output_path);
         }
+        jobio_close_input(&job_io, input);
     }
-
-    closedir(dir);
-}
\ No newline at end of file
+    jobio_flush(&job_io);
+    free(jobs);
+}
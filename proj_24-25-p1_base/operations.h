@@ -2,10 +2,14 @@
 #define KVS_OPERATIONS_H
 
 #include <stddef.h>
+#include <stdio.h>
 
-/// Initializes the KVS state.
+#include "config.h"
+
+/// Initializes the KVS state and starts the expiration reaper.
+/// @param config Configuration of the KVS.
 /// @return 0 if the KVS state was initialized successfully, 1 otherwise.
-int kvs_init();
+int kvs_init(const KvsConfig *config);
 
 /// Destroys the KVS state.
 /// @return 0 if the KVS state was terminated successfully, 1 otherwise.
@@ -15,8 +19,9 @@ int kvs_terminate();
 /// @param num_pairs Number of pairs being written.
 /// @param keys Array of keys' strings.
 /// @param values Array of values' strings.
+/// @param ttls Array of times to live in milliseconds (0 if the pair never expires).
 /// @return 0 if the pairs were written successfully, 1 otherwise.
-int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE]);
+int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], unsigned int ttls[]);
 
 /// Reads values from the KVS.
 /// @param num_pairs Number of pairs to read.
@@ -31,14 +36,48 @@ int kvs_read(size_t num_pairs, char keys[][MAX_STRING_SIZE]);
 /// @return 0 if the pairs were deleted successfully, 1 otherwise.
 int kvs_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE]);
 
+/// Stream the commands of the calling thread write their output to.
+/// @return Stream set by kvs_set_output, stdout by default.
+FILE *kvs_output();
+
+/// Redirects the output of the commands of the calling thread.
+/// @param out Stream to write to, NULL for stdout.
+void kvs_set_output(FILE *out);
+
+/// Sets whether READs of several keys by the calling thread read them at a
+/// single snapshot. Callers that keep writers away from the keys of a READ
+/// while it runs turn them off, so its writers are not made to keep versions.
+/// @param enabled 1 to read batches at a snapshot (the default), 0 otherwise.
+void kvs_set_read_snapshots(int enabled);
+
+/// Checks if a key has a node in the table, so that writing it would update
+/// the node rather than link a new one.
+/// @param key Key to be searched for.
+/// @return 1 if the key has a node, 0 otherwise.
+int kvs_has_key(const char *key);
+
 /// Writes the state of the KVS.
 /// @param fd File descriptor to write the output.
 void kvs_show();
 
+/// Writes the memory usage, eviction and expiration counters of the KVS.
+void kvs_stats();
+
+/// Writes the most read keys of the KVS with their estimated reads, most read first.
+void kvs_hotkeys();
+
+/// Loads the pairs of a text or binary file (see load.h) using the worker pool.
+/// @param path Path of the file.
+/// @return 0 if the file was loaded, 1 otherwise.
+int kvs_load(const char *path);
+
 /// Creates a backup of the KVS state and stores it in the correspondent
-/// backup file
+/// backup file. Backups after the first one are deltas chained to the
+/// previous backup, compacted into a full snapshot every
+/// BACKUP_COMPACT_INTERVAL backups.
+/// @param backup_path Path of the backup file.
 /// @return 0 if the backup was successful, 1 otherwise.
-int kvs_backup();
+int kvs_backup(const char *backup_path);
 
 /// Waits for the last backup to be called.
 void kvs_wait_backup();
@@ -47,6 +86,26 @@ void kvs_wait_backup();
 /// @param delay_us Delay in milliseconds.
 void kvs_wait(unsigned int delay_ms);
 
+/// Joins a directory and a file name into a path.
+/// @param directory_path Directory, with or without a trailing slash.
+/// @param name File name.
+/// @param path Buffer to store the path in.
+/// @param size Size of the buffer.
+/// @return 0 if the path fits the buffer, 1 otherwise.
+int kvs_join_path(const char *directory_path, const char *name, char *path, size_t size);
+
+/// Checks if a path names a job file (ends with .job).
+/// @param path Path to check.
+/// @return 1 if the path is a job, 0 otherwise.
+int kvs_is_job(const char *path);
+
+/// Runs a job file, writing its output to the .out file next to it.
+/// @param input_path Path of the .job file.
+/// @param skip_up_to_date Whether to skip jobs whose .out is newer than the job.
+void kvs_process_job(const char *input_path, int skip_up_to_date);
+
+/// Runs every job file of a directory.
+/// @param directory_path Directory to scan.
 void kvs_process_directory(const char *directory_path);
 
 #endif  // KVS_OPERATIONS_H
@@ -1,12 +1,46 @@
 #include "parser.h"
 
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "constants.h"
 
+// Inputs read from memory, by descriptor. Other descriptors are read from the kernel.
+static _Atomic(ParserInput *) inputs[PARSER_MAX_INPUTS];
+
+int parser_attach(int fd, ParserInput *input) {
+  if (fd < 0 || fd >= PARSER_MAX_INPUTS) {
+    return 1;
+  }
+  atomic_store_explicit(&inputs[fd], input, memory_order_release);
+  return 0;
+}
+
+void parser_detach(int fd) {
+  if (fd >= 0 && fd < PARSER_MAX_INPUTS) {
+    atomic_store_explicit(&inputs[fd], NULL, memory_order_release);
+  }
+}
+
+static ssize_t input_read(int fd, void *buf, size_t count) {
+  ParserInput *input =
+      fd >= 0 && fd < PARSER_MAX_INPUTS ? atomic_load_explicit(&inputs[fd], memory_order_acquire) : NULL;
+  if (input == NULL) {
+    return read(fd, buf, count);
+  }
+
+  size_t left = input->size - input->offset;
+  if (count > left) {
+    count = left;
+  }
+  memcpy(buf, input->data + input->offset, count);
+  input->offset += count;
+  return (ssize_t)count;
+}
+
 static int read_string(int fd, char *buffer, size_t max) {
   ssize_t bytes_read;
   char ch;
@@ -14,7 +48,7 @@ static int read_string(int fd, char *buffer, size_t max) {
   int value = -1;
 
   while (i < max) {
-    bytes_read = read(fd, &ch, 1);
+    bytes_read = input_read(fd, &ch, 1);
 
     if (bytes_read <= 0) {
         return -1;
@@ -45,12 +79,19 @@ static int read_string(int fd, char *buffer, size_t max) {
   return value;
 }
 
-static int read_uint(int fd, unsigned int *value, char *next) {
+// Reads an unsigned integer up to the first non-digit, stored in next.
+// @return 0 if it was read, 1 if it overflows or is empty when a value is required.
+static int read_uint(int fd, unsigned int *value, char *next, int required) {
   char buf[16];
 
   int i = 0;
   while (1) {
-    if (read(fd, buf + i, 1) == 0) {
+    if (i == (int)sizeof(buf) - 1) {
+      return 1;
+    }
+
+    if (input_read(fd, buf + i, 1) <= 0) {
+      buf[i] = '\0';
       *next = '\0';
       break;
     }
@@ -67,7 +108,7 @@ static int read_uint(int fd, unsigned int *value, char *next) {
 
   unsigned long ul = strtoul(buf, NULL, 10);
 
-  if (ul > UINT_MAX) {
+  if (ul > UINT_MAX || (required && i == 0)) {
     return 1;
   }
 
@@ -78,30 +119,30 @@ static int read_uint(int fd, unsigned int *value, char *next) {
 
 static void cleanup(int fd) {
   char ch;
-  while (read(fd, &ch, 1) == 1 && ch != '\n')
+  while (input_read(fd, &ch, 1) == 1 && ch != '\n')
     ;
 }
 
 enum Command get_next(int fd) {
   char buf[16];
-  if (read(fd, buf, 1) != 1) {
+  if (input_read(fd, buf, 1) != 1) {
     return EOC;
   }
 
   switch (buf[0]) {
     case 'W':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
-        if (read(fd, buf + 5, 1) != 1 || strncmp(buf, "WRITE ", 6) != 0) {
+      if (input_read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
+        if (input_read(fd, buf + 5, 1) != 1 || (strncmp(buf, "WRITE ", 6) != 0 && strncmp(buf, "WATCH ", 6) != 0)) {
           cleanup(fd);
           return CMD_INVALID;
         }
-        return CMD_WRITE;
+        return buf[1] == 'R' ? CMD_WRITE : CMD_WATCH;
       }
 
       return CMD_WAIT;
 
     case 'R':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "READ ", 5) != 0) {
+      if (input_read(fd, buf + 1, 4) != 4 || strncmp(buf, "READ ", 5) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -109,7 +150,7 @@ enum Command get_next(int fd) {
       return CMD_READ;
 
     case 'D':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "DELETE ", 7) != 0) {
+      if (input_read(fd, buf + 1, 6) != 6 || strncmp(buf, "DELETE ", 7) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -117,12 +158,26 @@ enum Command get_next(int fd) {
       return CMD_DELETE;
 
     case 'S':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "SHOW", 4) != 0) {
+      if (input_read(fd, buf + 1, 3) != 3 || (strncmp(buf, "SHOW", 4) != 0 && strncmp(buf, "STAT", 4) != 0)) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
+      if (buf[1] == 'T') {
+        if (input_read(fd, buf + 4, 1) != 1 || buf[4] != 'S') {
+          cleanup(fd);
+          return CMD_INVALID;
+        }
+
+        if (input_read(fd, buf + 5, 1) != 0 && buf[5] != '\n') {
+          cleanup(fd);
+          return CMD_INVALID;
+        }
+
+        return CMD_STATS;
+      }
+
+      if (input_read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -130,12 +185,12 @@ enum Command get_next(int fd) {
       return CMD_SHOW;
 
     case 'B':
-      if (read(fd, buf + 1, 5) != 5 || strncmp(buf, "BACKUP", 6) != 0) {
+      if (input_read(fd, buf + 1, 5) != 5 || strncmp(buf, "BACKUP", 6) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 6, 1) != 0 && buf[6] != '\n') {
+      if (input_read(fd, buf + 6, 1) != 0 && buf[6] != '\n') {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -143,12 +198,26 @@ enum Command get_next(int fd) {
       return CMD_BACKUP;
 
     case 'H':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
+      if (input_read(fd, buf + 1, 3) != 3 || (strncmp(buf, "HELP", 4) != 0 && strncmp(buf, "HOTK", 4) != 0)) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
+      if (buf[1] == 'O') {
+        if (input_read(fd, buf + 4, 3) != 3 || strncmp(buf, "HOTKEYS", 7) != 0) {
+          cleanup(fd);
+          return CMD_INVALID;
+        }
+
+        if (input_read(fd, buf + 7, 1) != 0 && buf[7] != '\n') {
+          cleanup(fd);
+          return CMD_INVALID;
+        }
+
+        return CMD_HOTKEYS;
+      }
+
+      if (input_read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -156,14 +225,21 @@ enum Command get_next(int fd) {
       return CMD_HELP;
 
     case 'O':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "OPENDIR", 7) != 0) {
+      if (input_read(fd, buf + 1, 6) != 6 || strncmp(buf, "OPENDIR", 7) != 0) {
                 cleanup(fd);
                 return CMD_INVALID;
             }
             return CMD_OPENDIR;
     
+    case 'L':
+      if (input_read(fd, buf + 1, 4) != 4 || strncmp(buf, "LOAD ", 5) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+      return CMD_LOAD;
+
     case 'Q':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "QUIT", 4) != 0) {
+      if (input_read(fd, buf + 1, 3) != 3 || strncmp(buf, "QUIT", 4) != 0) {
                 cleanup(fd);
                 return CMD_INVALID;
             }
@@ -182,13 +258,22 @@ enum Command get_next(int fd) {
   }
 }
 
-int parse_pair(int fd, char *key, char *value) {
+int parse_pair(int fd, char *key, char *value, unsigned int *ttl) {
   if (read_string(fd, key, MAX_STRING_SIZE) != 0) {
     cleanup(fd);
     return 0;
   }
 
-  if (read_string(fd, value, MAX_STRING_SIZE) != 1) {
+  *ttl = 0;
+  int output = read_string(fd, value, MAX_STRING_SIZE);
+  if (output == 0) {
+    // Optional time to live after the value
+    char ch;
+    if (read_uint(fd, ttl, &ch, 1) != 0 || ch != ')') {
+      cleanup(fd);
+      return 0;
+    }
+  } else if (output != 1) {
     cleanup(fd);
     return 0;
   }
@@ -196,15 +281,15 @@ int parse_pair(int fd, char *key, char *value) {
   return 1;
 }
 
-size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], size_t max_pairs, size_t max_string_size) {
+size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], unsigned int ttls[], size_t max_pairs, size_t max_string_size) {
   char ch;
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
+  if (input_read(fd, &ch, 1) != 1 || ch != '[') {
     cleanup(fd);
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || ch != '(') {
+  if (input_read(fd, &ch, 1) != 1 || ch != '(') {
     cleanup(fd);
     return 0;
   }
@@ -212,16 +297,18 @@ size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRIN
   size_t num_pairs = 0;
   char key[max_string_size];
   char value[max_string_size];
+  unsigned int ttl;
   while (num_pairs < max_pairs) {
-    if(parse_pair(fd, key, value) == 0) {
+    if(parse_pair(fd, key, value, &ttl) == 0) {
       cleanup(fd);
       return 0;
     }
 
+    ttls[num_pairs] = ttl;
     strcpy(keys[num_pairs], key);
     strcpy(values[num_pairs++], value);
 
-    if (read(fd, &ch, 1) != 1 || (ch != '(' && ch != ']')) {
+    if (input_read(fd, &ch, 1) != 1 || (ch != '(' && ch != ']')) {
       cleanup(fd);
       return 0;
     }
@@ -236,7 +323,7 @@ size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRIN
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
+  if (input_read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
     cleanup(fd);
     return 0;
   }
@@ -247,7 +334,7 @@ size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRIN
 size_t parse_read_delete(int fd, char keys[][MAX_STRING_SIZE], size_t max_keys, size_t max_string_size) {
   char ch;
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
+  if (input_read(fd, &ch, 1) != 1 || ch != '[') {
     cleanup(fd);
     return 0;
   }
@@ -273,7 +360,7 @@ size_t parse_read_delete(int fd, char keys[][MAX_STRING_SIZE], size_t max_keys,
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
+  if (input_read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
     cleanup(fd);
     return 0;
   }
@@ -281,10 +368,30 @@ size_t parse_read_delete(int fd, char keys[][MAX_STRING_SIZE], size_t max_keys,
   return num_keys;
 }
 
+size_t parse_path(int fd, char *path, size_t max_size) {
+  char ch;
+  size_t len = 0;
+  int too_long = 0;
+
+  while (input_read(fd, &ch, 1) == 1 && ch != '\n') {
+    if (len == 0 && (ch == ' ' || ch == '\t')) {
+      continue;
+    }
+    if (len + 1 < max_size) {
+      path[len++] = ch;
+    } else {
+      too_long = 1;
+    }
+  }
+
+  path[len] = '\0';
+  return too_long ? 0 : len;
+}
+
 int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
   char ch;
 
-  if (read_uint(fd, delay, &ch) != 0) {
+  if (read_uint(fd, delay, &ch, 0) != 0) {
     cleanup(fd);
     return -1;
   }
@@ -295,7 +402,7 @@ int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
       return 0;
     }
 
-    if (read_uint(fd, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    if (read_uint(fd, thread_id, &ch, 0) != 0 || (ch != '\n' && ch != '\0')) {
       cleanup(fd);
       return -1;
     }
@@ -4,6 +4,15 @@
 #include <stddef.h>
 #include "constants.h"
 
+#define PARSER_MAX_INPUTS 1024  // Descriptors that can be read from memory
+
+// Contents of a descriptor already read in memory.
+typedef struct ParserInput {
+  const char *data;
+  size_t size;
+  size_t offset;  // Next byte to be parsed
+} ParserInput;
+
 enum Command {
   CMD_WRITE,
   CMD_READ,
@@ -16,9 +25,24 @@ enum Command {
   CMD_INVALID,
   CMD_OPENDIR,
   CMD_QUIT,
+  CMD_STATS,
+  CMD_WATCH,
+  CMD_LOAD,
+  CMD_HOTKEYS,
   EOC  // End of commands
 };
 
+/// Makes the parser read a descriptor from memory, so commands are not
+/// parsed with a system call per byte. The descriptor itself is not read.
+/// @param fd Descriptor the contents were read from, kept open while attached.
+/// @param input Contents of the descriptor, read by a single thread at a time.
+/// @return 0 if the descriptor was attached, 1 if it is PARSER_MAX_INPUTS or above.
+int parser_attach(int fd, ParserInput *input);
+
+/// Makes the parser read a descriptor from the kernel again.
+/// @param fd Descriptor to detach.
+void parser_detach(int fd);
+
 /// Reads a line and returns the corresponding command.
 /// @param fd File descriptor to read from.
 /// @return The command read.
@@ -28,10 +52,11 @@ enum Command get_next(int fd);
 /// @param fd File descriptor to read from.
 /// @param keys Array of keys to be written.
 /// @param values Array of values to be written.
+/// @param ttls Array of times to live (in milliseconds, 0 if the pair never expires) to be written.
 /// @param max_pairs number of pairs to be written.
 /// @param max_string_size maximum size for keys and values.
 /// @return 0 if the command was parsed successfully, 1 otherwise.
-size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], size_t max_pairs, size_t max_string_size);
+size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], unsigned int ttls[], size_t max_pairs, size_t max_string_size);
 
 /// Parses a READ or DELETE command.
 /// @param fd File descriptor to read from.
@@ -41,6 +66,13 @@ size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRIN
 /// @return Number of keys read or deleted. 0 on failure.
 size_t parse_read_delete(int fd, char keys[][MAX_STRING_SIZE], size_t max_keys, size_t max_string_size);
 
+/// Parses the path argument of an OPENDIR, WATCH or LOAD command (the rest of the line).
+/// @param fd File descriptor to read from.
+/// @param path Buffer to store the path in.
+/// @param max_size Size of the buffer.
+/// @return Length of the path. 0 on failure.
+size_t parse_path(int fd, char *path, size_t max_size);
+
 /// Parses a WAIT command.
 /// @param fd File descriptor to read from.
 /// @param delay Pointer to the variable to store the wait delay in.
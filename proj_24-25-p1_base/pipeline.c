@@ -0,0 +1,94 @@
+#include "pipeline.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "constants.h"
+
+typedef struct CommandRing {
+  CommandRecord *records;
+  size_t head;                 // Next record to be executed
+  size_t tail;                 // Next record to be parsed
+  pthread_mutex_t lock;
+  pthread_cond_t parsed;       // Signaled when a record is published
+  pthread_cond_t executed;     // Signaled when a record is released
+  int fd;
+} CommandRing;
+
+// Parser stage: fills free records in place and publishes them, up to and
+// including the end of the job.
+static void *parser_stage(void *arg) {
+  CommandRing *ring = arg;
+
+  while (1) {
+    pthread_mutex_lock(&ring->lock);
+    while (ring->tail - ring->head == PIPELINE_DEPTH) {
+      pthread_cond_wait(&ring->executed, &ring->lock);
+    }
+    CommandRecord *record = &ring->records[ring->tail % PIPELINE_DEPTH];
+    pthread_mutex_unlock(&ring->lock);
+
+    // The record is not visible to the executor until tail moves past it
+    parse_command(ring->fd, record);
+
+    pthread_mutex_lock(&ring->lock);
+    ring->tail++;
+    pthread_cond_signal(&ring->parsed);
+    pthread_mutex_unlock(&ring->lock);
+
+    if (record->cmd == EOC) {
+      return NULL;
+    }
+  }
+}
+
+int pipeline_run(int fd, CommandContext *context) {
+  CommandRing ring = {.head = 0, .tail = 0, .fd = fd};
+  ring.records = malloc(PIPELINE_DEPTH * sizeof(CommandRecord));
+  if (ring.records == NULL) {
+    perror("Failed to allocate command ring");
+    return 1;
+  }
+
+  pthread_mutex_init(&ring.lock, NULL);
+  pthread_cond_init(&ring.parsed, NULL);
+  pthread_cond_init(&ring.executed, NULL);
+
+  pthread_t parser;
+  if (pthread_create(&parser, NULL, parser_stage, &ring) != 0) {
+    fprintf(stderr, "Failed to start parser thread\n");
+    pthread_cond_destroy(&ring.executed);
+    pthread_cond_destroy(&ring.parsed);
+    pthread_mutex_destroy(&ring.lock);
+    free(ring.records);
+    return 1;
+  }
+
+  // Executor stage, on the calling thread so output goes to its output stream
+  while (1) {
+    pthread_mutex_lock(&ring.lock);
+    while (ring.head == ring.tail) {
+      pthread_cond_wait(&ring.parsed, &ring.lock);
+    }
+    CommandRecord *record = &ring.records[ring.head % PIPELINE_DEPTH];
+    pthread_mutex_unlock(&ring.lock);
+
+    if (record->cmd == EOC) {
+      break;
+    }
+    execute_command(record, context);
+
+    pthread_mutex_lock(&ring.lock);
+    ring.head++;
+    pthread_cond_signal(&ring.executed);
+    pthread_mutex_unlock(&ring.lock);
+  }
+
+  pthread_join(parser, NULL);
+  pthread_cond_destroy(&ring.executed);
+  pthread_cond_destroy(&ring.parsed);
+  pthread_mutex_destroy(&ring.lock);
+  free(ring.records);
+  return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef KVS_PIPELINE_H
+#define KVS_PIPELINE_H
+
+#include "command.h"
+
+/// Runs a job in two stages: a parser thread decodes the commands into a
+/// ring of PIPELINE_DEPTH records while the calling thread executes them in
+/// order. The parser may run ahead of the executor (including during a
+/// WAIT), but commands are executed and their output written one at a time,
+/// in the order of the job.
+/// @param fd File descriptor of the job.
+/// @param context Context of the job.
+/// @return 0 if the job ran to the end, 1 if the pipeline could not be
+/// started (nothing has been read from fd in that case).
+int pipeline_run(int fd, CommandContext *context);
+
+#endif  // KVS_PIPELINE_H
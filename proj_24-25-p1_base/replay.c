@@ -0,0 +1,428 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "command.h"
+#include "config.h"
+#include "constants.h"
+#include "operations.h"
+#include "trace.h"
+
+#define MAX_REPLAY_THREADS 256
+
+static const char *command_names[EOC] = {
+    [CMD_WRITE] = "WRITE",   [CMD_READ] = "READ",     [CMD_DELETE] = "DELETE", [CMD_SHOW] = "SHOW",
+    [CMD_WAIT] = "WAIT",     [CMD_BACKUP] = "BACKUP", [CMD_HELP] = "HELP",     [CMD_EMPTY] = "EMPTY",
+    [CMD_INVALID] = "INVALID", [CMD_OPENDIR] = "OPENDIR", [CMD_QUIT] = "QUIT", [CMD_STATS] = "STATS",
+    [CMD_WATCH] = "WATCH",   [CMD_LOAD] = "LOAD",     [CMD_HOTKEYS] = "HOTKEYS",
+};
+
+typedef struct LatencyLog {
+  uint64_t *samples;   // Nanoseconds
+  size_t count;
+  size_t capacity;
+} LatencyLog;
+
+typedef struct Replay {
+  TraceEvent *events;          // Commands of the trace, in trace order
+  size_t num_events;
+  CommandContext *contexts;    // Context of each session, by index
+  uint32_t *session_ids;       // Id in the trace of each session, by index
+  size_t num_sessions;
+  double speed;                // Speed factor, 0 to replay as fast as possible
+  uint64_t start_ns;
+} Replay;
+
+typedef struct ReplayThread {
+  pthread_t thread;
+  Replay *replay;
+  size_t *events;              // Indexes of the events of its sessions, in trace order
+  size_t num_events;
+  LatencyLog latencies[EOC];   // By command
+  size_t skipped;              // Corrupted commands
+} ReplayThread;
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline_ns) {
+  struct timespec ts = {(time_t)(deadline_ns / 1000000000), (long)(deadline_ns % 1000000000)};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+    // Interrupted, sleep the rest
+  }
+}
+
+static void log_latency(LatencyLog *log, uint64_t latency) {
+  if (log->count == log->capacity) {
+    size_t capacity = log->capacity != 0 ? 2 * log->capacity : 1024;
+    uint64_t *samples = realloc(log->samples, capacity * sizeof(uint64_t));
+    if (samples == NULL) {
+      return; // The sample is lost, the replay goes on
+    }
+    log->samples = samples;
+    log->capacity = capacity;
+  }
+  log->samples[log->count++] = latency;
+}
+
+// Replays the sessions of a thread. When paced, latencies are measured from
+// the time the command was due, so commands stuck behind slow ones count
+// the time they waited.
+static void *replay_thread(void *arg) {
+  ReplayThread *self = arg;
+  Replay *replay = self->replay;
+
+  CommandRecord *record = malloc(sizeof(CommandRecord));
+  if (record == NULL) {
+    perror("Failed to allocate command record");
+    return NULL;
+  }
+
+  for (size_t i = 0; i < self->num_events; i++) {
+    const TraceEvent *event = &replay->events[self->events[i]];
+    uint64_t due = replay->start_ns;
+    if (replay->speed > 0) {
+      due += (uint64_t)((double)event->time_us * 1000 / replay->speed);
+      sleep_until(due);
+    }
+
+    trace_decode_command(event, record);
+    if (record->cmd == CMD_INVALID) {
+      self->skipped++;
+      continue;
+    }
+    if (record->cmd == CMD_WAIT) {
+      continue; // The delay is already in the times of the commands that follow
+    }
+
+    uint64_t begin = now_ns();
+    execute_command(record, &replay->contexts[event->session_id]);
+    uint64_t end = now_ns();
+    log_latency(&self->latencies[record->cmd], end - (replay->speed > 0 ? due : begin));
+  }
+
+  free(record);
+  return NULL;
+}
+
+static int compare_latency(const void *a, const void *b) {
+  uint64_t latency_a = *(const uint64_t *)a;
+  uint64_t latency_b = *(const uint64_t *)b;
+  return (latency_a > latency_b) - (latency_a < latency_b);
+}
+
+static double percentile_us(const LatencyLog *log, size_t per_mille) {
+  size_t index = log->count * per_mille / 1000;
+  if (index >= log->count) {
+    index = log->count - 1;
+  }
+  return (double)log->samples[index] / 1000;
+}
+
+// Merges the latencies of the threads by command and writes their percentiles.
+static void report(ReplayThread *threads, size_t num_threads, const Replay *replay, double seconds) {
+  size_t total = 0;
+  size_t skipped = 0;
+  for (size_t t = 0; t < num_threads; t++) {
+    skipped += threads[t].skipped;
+  }
+
+  LatencyLog merged[EOC];
+  for (int cmd = 0; cmd < EOC; cmd++) {
+    merged[cmd] = (LatencyLog){NULL, 0, 0};
+    for (size_t t = 0; t < num_threads; t++) {
+      const LatencyLog *log = &threads[t].latencies[cmd];
+      for (size_t i = 0; i < log->count; i++) {
+        log_latency(&merged[cmd], log->samples[i]);
+      }
+    }
+    total += merged[cmd].count;
+  }
+
+  printf("Replayed %zu commands of %zu sessions on %zu threads in %.3f s (%.0f commands/s)\n", total,
+         replay->num_sessions, num_threads, seconds, seconds > 0 ? (double)total / seconds : 0);
+  if (skipped > 0) {
+    printf("Skipped %zu corrupted commands\n", skipped);
+  }
+  printf("(command, count, p50_us, p90_us, p99_us, p999_us, max_us)\n");
+  for (int cmd = 0; cmd < EOC; cmd++) {
+    LatencyLog *log = &merged[cmd];
+    if (log->count > 0) {
+      qsort(log->samples, log->count, sizeof(uint64_t), compare_latency);
+      printf("(%s, %zu, %.1f, %.1f, %.1f, %.1f, %.1f)\n", command_names[cmd], log->count, percentile_us(log, 500),
+             percentile_us(log, 900), percentile_us(log, 990), percentile_us(log, 999),
+             (double)log->samples[log->count - 1] / 1000);
+    }
+    free(log->samples);
+  }
+}
+
+// Sessions of a trace by id, as ids are only numbered densely by well-formed traces.
+typedef struct SessionMap {
+  uint32_t *slots;   // Index of the session plus one, 0 if the slot is free
+  size_t capacity;   // Power of two
+} SessionMap;
+
+// Finds the index of a session, adding it if its id was not seen yet.
+// @return 0 if the session was found or added, 1 if memory ran out.
+static int session_index(Replay *replay, SessionMap *map, uint32_t id, size_t *index) {
+  if (2 * (replay->num_sessions + 1) > map->capacity) {
+    size_t capacity = map->capacity != 0 ? 2 * map->capacity : 64;
+    uint32_t *slots = calloc(capacity, sizeof(uint32_t));
+    uint32_t *ids = realloc(replay->session_ids, capacity / 2 * sizeof(uint32_t));
+    if (ids != NULL) {
+      replay->session_ids = ids;
+    }
+    if (slots == NULL || ids == NULL) {
+      free(slots);
+      return 1;
+    }
+    for (size_t i = 0; i < replay->num_sessions; i++) {
+      size_t slot = (size_t)replay->session_ids[i] * 2654435761u & (capacity - 1);
+      while (slots[slot] != 0) {
+        slot = (slot + 1) & (capacity - 1);
+      }
+      slots[slot] = (uint32_t)i + 1;
+    }
+    free(map->slots);
+    map->slots = slots;
+    map->capacity = capacity;
+  }
+
+  size_t slot = (size_t)id * 2654435761u & (map->capacity - 1);
+  while (map->slots[slot] != 0) {
+    if (replay->session_ids[map->slots[slot] - 1] == id) {
+      *index = map->slots[slot] - 1;
+      return 0;
+    }
+    slot = (slot + 1) & (map->capacity - 1);
+  }
+  *index = replay->num_sessions++;
+  replay->session_ids[*index] = id;
+  map->slots[slot] = (uint32_t)*index + 1;
+  return 0;
+}
+
+// Reads the commands of a trace and creates a context for each of its sessions.
+// Session ids of the events are replaced by the index of their session.
+static int load_trace(Replay *replay, const uint8_t *data, size_t size) {
+  TraceCursor cursor;
+  if (trace_cursor_init(&cursor, data, size) != 0) {
+    fprintf(stderr, "Not a trace file\n");
+    return 1;
+  }
+
+  SessionMap map = {.slots = NULL, .capacity = 0};
+  size_t capacity = 0;
+  TraceEvent event;
+  int result;
+  while ((result = trace_next(&cursor, &event)) == 1) {
+    // At most one session per entry, so a trace cannot claim more than it holds
+    size_t index;
+    if (session_index(replay, &map, event.session_id, &index) != 0) {
+      perror("Failed to allocate sessions");
+      free(map.slots);
+      return 1;
+    }
+    if (event.session) {
+      continue;
+    }
+    event.session_id = (uint32_t)index;
+
+    if (replay->num_events == capacity) {
+      capacity = capacity != 0 ? 2 * capacity : 1024;
+      TraceEvent *events = realloc(replay->events, capacity * sizeof(TraceEvent));
+      if (events == NULL) {
+        perror("Failed to allocate trace events");
+        free(map.slots);
+        return 1;
+      }
+      replay->events = events;
+    }
+    replay->events[replay->num_events++] = event;
+  }
+  free(map.slots);
+  if (result < 0) {
+    fprintf(stderr, "Trace is corrupted after %zu commands, replaying those\n", replay->num_events);
+  }
+
+  replay->contexts = malloc((replay->num_sessions + 1) * sizeof(CommandContext));
+  if (replay->contexts == NULL) {
+    perror("Failed to allocate sessions");
+    return 1;
+  }
+  for (size_t i = 0; i < replay->num_sessions; i++) {
+    // Backups of the replay are named replay-<session>-<n>.bck, not to overwrite those of the capture
+    char prefix[32];
+    int len = snprintf(prefix, sizeof(prefix), "replay-%u", replay->session_ids[i]);
+    command_context_init(&replay->contexts[i], prefix, (size_t)len);
+  }
+  return 0;
+}
+
+// Spreads the sessions over the threads, each session replayed in order by a single thread.
+static int split_sessions(const Replay *replay, ReplayThread *threads, size_t num_threads) {
+  for (size_t t = 0; t < num_threads; t++) {
+    threads[t].events = malloc((replay->num_events + 1) * sizeof(size_t));
+    if (threads[t].events == NULL) {
+      perror("Failed to allocate replay thread");
+      return 1;
+    }
+  }
+
+  for (size_t i = 0; i < replay->num_events; i++) {
+    ReplayThread *thread = &threads[replay->events[i].session_id % num_threads];
+    thread->events[thread->num_events++] = i;
+  }
+  return 0;
+}
+
+static void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [-s <speed>] [-n <threads>] <trace> [-- <kvs options>]\n"
+          "  -s <speed>   Speed factor: 1 replays in real time, N N times faster, 0 as fast as possible (default: 1)\n"
+          "  -n <threads> Threads the sessions are spread over (default: 1)\n",
+          program);
+}
+
+int main(int argc, char *argv[]) {
+  // Options after "--" configure the instance the trace is replayed against
+  int replay_argc = argc;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--") == 0) {
+      replay_argc = i;
+      break;
+    }
+  }
+
+  double speed = 1;
+  size_t num_threads = 1;
+  int opt;
+  while ((opt = getopt(replay_argc, argv, "s:n:")) != -1) {
+    char *end;
+    switch (opt) {
+      case 's':
+        speed = strtod(optarg, &end);
+        if (end == optarg || *end != '\0' || speed < 0) {
+          fprintf(stderr, "Invalid speed: %s\n", optarg);
+          return 1;
+        }
+        break;
+
+      case 'n': {
+        unsigned long threads = strtoul(optarg, &end, 10);
+        if (end == optarg || *end != '\0' || threads == 0 || threads > MAX_REPLAY_THREADS) {
+          fprintf(stderr, "Invalid number of threads: %s\n", optarg);
+          return 1;
+        }
+        num_threads = (size_t)threads;
+        break;
+      }
+
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind + 1 != replay_argc) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  const char *trace_path = argv[optind];
+
+  KvsConfig config;
+  if (replay_argc < argc) {
+    optind = 1;
+    if (parse_config(argc - replay_argc, argv + replay_argc, &config) != 0) {
+      return 1;
+    }
+  } else {
+    config_defaults(&config);
+  }
+
+  int fd = open(trace_path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(trace_path);
+    return 1;
+  }
+  size_t size = (size_t)st.st_size;
+  const uint8_t *data = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+  close(fd);
+  if (data == MAP_FAILED || data == NULL) {
+    fprintf(stderr, "Failed to map %s\n", trace_path);
+    return 1;
+  }
+
+  if (kvs_init(&config)) {
+    fprintf(stderr, "Failed to initialize KVS\n");
+    munmap((void *)data, size);
+    return 1;
+  }
+
+  Replay replay = {.events = NULL, .num_events = 0, .contexts = NULL, .session_ids = NULL,
+                   .num_sessions = 0, .speed = speed};
+  ReplayThread *threads = calloc(num_threads, sizeof(ReplayThread));
+  int result = threads == NULL || load_trace(&replay, data, size) != 0 ||
+               split_sessions(&replay, threads, num_threads) != 0;
+
+  // The output of the commands is discarded, only the report is written
+  int report_fd = dup(STDOUT_FILENO);
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (result == 0 && (report_fd < 0 || null_fd < 0 || dup2(null_fd, STDOUT_FILENO) < 0)) {
+    perror("Failed to redirect the output of the commands");
+    result = 1;
+  }
+
+  size_t started = 0;
+  replay.start_ns = now_ns();
+  for (; result == 0 && started < num_threads; started++) {
+    threads[started].replay = &replay;
+    if (pthread_create(&threads[started].thread, NULL, replay_thread, &threads[started]) != 0) {
+      fprintf(stderr, "Failed to start replay thread\n");
+      result = 1;
+      break;
+    }
+  }
+  for (size_t t = 0; t < started; t++) {
+    pthread_join(threads[t].thread, NULL);
+  }
+  double seconds = (double)(now_ns() - replay.start_ns) / 1e9;
+
+  fflush(stdout);
+  if (report_fd >= 0) {
+    dup2(report_fd, STDOUT_FILENO);
+    close(report_fd);
+  }
+  if (null_fd >= 0) {
+    close(null_fd);
+  }
+
+  if (result == 0) {
+    report(threads, num_threads, &replay, seconds);
+  }
+
+  kvs_terminate();
+  for (size_t t = 0; threads != NULL && t < num_threads; t++) {
+    free(threads[t].events);
+    for (int cmd = 0; cmd < EOC; cmd++) {
+      free(threads[t].latencies[cmd].samples);
+    }
+  }
+  free(threads);
+  free(replay.events);
+  free(replay.contexts);
+  free(replay.session_ids);
+  munmap((void *)data, size);
+  return result;
+}
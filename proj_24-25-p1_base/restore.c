@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "backup.h"
+#include "constants.h"
+#include "kvs.h"
+
+#define MAX_CHAIN_LENGTH 1024
+
+// Splits a "(key, value)" or "(key, value, ttl_ms)" line in place; ttl_ms is 0 when there is none.
+// @return 0 if the line is a pair, 1 otherwise.
+static int parse_pair_line(char *line, char **key, char **value, unsigned int *ttl_ms) {
+  char *separator = strstr(line, ", ");
+  char *end = strrchr(line, ')');
+  if (line[0] != '(' || separator == NULL || end == NULL || end < separator) {
+    return 1;
+  }
+
+  *separator = '\0';
+  *end = '\0';
+  *key = line + 1;
+  *value = separator + 2;
+  *ttl_ms = 0;
+
+  char *ttl = strstr(*value, ", ");
+  if (ttl != NULL) {
+    char *ttl_end;
+    unsigned long parsed = strtoul(ttl + 2, &ttl_end, 10);
+    if (*ttl_end != '\0' || parsed > UINT_MAX) {
+      return 1;
+    }
+    *ttl = '\0';
+    *ttl_ms = (unsigned int)parsed;
+  }
+  return 0;
+}
+
+// Splits a "DELETE (key)" line in place.
+// @return 0 if the line is a delete, 1 otherwise.
+static int parse_delete_line(char *line, char **key) {
+  if (strncmp(line, "DELETE (", 8) != 0) {
+    return 1;
+  }
+
+  char *end = strrchr(line, ')');
+  if (end == NULL) {
+    return 1;
+  }
+
+  *end = '\0';
+  *key = line + 8;
+  return 0;
+}
+
+// Checks if the base of a delta was written after it, by a later run that named a backup the same way.
+static int rewritten_after(const char *base, const char *delta) {
+  struct stat base_stat;
+  struct stat delta_stat;
+  if (stat(base, &base_stat) != 0 || stat(delta, &delta_stat) != 0) {
+    return 0;  // A missing base is reported when it is opened
+  }
+  if (base_stat.st_mtim.tv_sec != delta_stat.st_mtim.tv_sec) {
+    return base_stat.st_mtim.tv_sec > delta_stat.st_mtim.tv_sec;
+  }
+  return base_stat.st_mtim.tv_nsec > delta_stat.st_mtim.tv_nsec;
+}
+
+// Rebuilds the table from a backup, applying the backups it is chained to first.
+static int apply_backup(HashTable *ht, const char *path, unsigned int depth) {
+  if (depth > MAX_CHAIN_LENGTH) {
+    fprintf(stderr, "Backup chain too long (cycle?) at %s\n", path);
+    return 1;
+  }
+
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    return 1;
+  }
+
+  char **lines = NULL;
+  size_t num_lines = 0;
+  size_t capacity = 0;
+  char *line = NULL;
+  size_t line_size = 0;
+  ssize_t len;
+  int result = 0;
+
+  while ((len = getline(&line, &line_size, file)) != -1) {
+    if (len > 0 && line[len - 1] == '\n') {
+      line[len - 1] = '\0';
+    }
+
+    if (num_lines == 0 && strncmp(line, DELTA_HEADER, strlen(DELTA_HEADER)) == 0) {
+      const char *base = line + strlen(DELTA_HEADER);
+      if (rewritten_after(base, path)) {
+        fprintf(stderr, "Backup %s was rewritten after %s, which applies to it\n", base, path);
+        result = 1;
+        break;
+      }
+      if (apply_backup(ht, base, depth + 1) != 0) {
+        result = 1;
+        break;
+      }
+    }
+
+    if (num_lines == capacity) {
+      capacity = capacity == 0 ? 64 : capacity * 2;
+      char **grown = realloc(lines, capacity * sizeof(char *));
+      if (grown == NULL) {
+        result = 1;
+        break;
+      }
+      lines = grown;
+    }
+    lines[num_lines++] = line;
+    line = NULL;
+    line_size = 0;
+  }
+  free(line);
+  fclose(file);
+
+  // Deletes go first; pairs are applied oldest first, so the buckets keep the order they were written in
+  for (size_t i = 0; result == 0 && i < num_lines; i++) {
+    char *key;
+    if (parse_delete_line(lines[i], &key) == 0) {
+      delete_pair(ht, key);
+    }
+  }
+  for (size_t i = num_lines; result == 0 && i > 0; i--) {
+    char *key;
+    char *value;
+    unsigned int ttl_ms;
+    if (parse_pair_line(lines[i - 1], &key, &value, &ttl_ms) == 0 && write_pair(ht, key, value, ttl_ms) != 0) {
+      fprintf(stderr, "Failed to restore pair (%s,%s)\n", key, value);
+      result = 1;
+    }
+  }
+
+  for (size_t i = 0; i < num_lines; i++) {
+    free(lines[i]);
+  }
+  free(lines);
+  return result;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <backup file>\n", argv[0]);
+    fprintf(stderr, "Applies the chain of backups ending in the given file and prints the resulting snapshot.\n");
+    return 1;
+  }
+
+  HashTable *ht = create_hash_table(0, 0, 0);
+  if (ht == NULL) {
+    fprintf(stderr, "Failed to create table\n");
+    return 1;
+  }
+
+  int result = apply_backup(ht, argv[1], 0);
+  if (result == 0) {
+    Snapshot snapshot;
+    snapshot_open(ht, &snapshot);
+    for (int i = 0; i < TABLE_SIZE; i++) {
+      for (KeyNode *keyNode = ht->table[i]; keyNode != NULL; keyNode = keyNode->next) {
+        const Version *version = snapshot_version(keyNode, &snapshot);
+        if (version != NULL) {
+          printf("(%s, %s)\n", keyNode->key, version->value);
+        }
+      }
+    }
+    snapshot_close(ht, &snapshot);
+  }
+
+  free_table(ht);
+  return result;
+}
@@ -0,0 +1,122 @@
+#!/bin/sh
+# Runs every fixture directory under jobs/ in a fresh kvs and compares what it
+# writes with the expected files next to the jobs: <job>.out for each job,
+# <backup>.restore for what restore prints from <backup>.bck and, in
+# directories captured into a trace, <name>.replay for the number of commands
+# of each kind replay runs from it. Jobs run with their directory as working
+# directory, so LOAD paths are relative to it.
+#
+# Directories with .restore files are also run twice in the same kvs, so the
+# second run writes over the backups the chain of the first one goes through.
+# Their jobs must leave the table as they found it for that to give the same
+# files again.
+#
+# Every fixture must give the same outputs under each of the option sets.
+# The jobs directly under jobs/ share one table and depend on the order they
+# are listed in, so they are not run here.
+#
+# WATCH is checked on a scratch tree changed while it is watched.
+
+cd "$(dirname "$0")" || exit 1
+KVS="$PWD/kvs"
+RESTORE="$PWD/restore"
+REPLAY="$PWD/replay"
+failed=0
+
+# Checks the files written in a scratch copy of a fixture directory.
+# $1: fixture directory, $2: scratch directory, $3: description of the run.
+check_outputs() {
+  for expected in "$1"/*.out "$1"/*.restore "$1"/*.replay; do
+    [ -e "$expected" ] || continue
+    name=$(basename "$expected")
+    case "$name" in
+      *.out) actual=$(cat "$2/$name" 2>/dev/null) ;;
+      *.restore) actual=$("$RESTORE" "$2/${name%.restore}.bck" 2>&1) ;;
+      *.replay)
+        # Timings vary from run to run, only the counts are compared
+        actual=$("$REPLAY" -s 0 "$2.trace" 2>&1 |
+          awk -F'[(), ]+' '/^Replayed/ { print $1, $2, $3 } /^\([A-Z]/ { printf "(%s, %s)\n", $2, $3 }') ;;
+    esac
+    if [ "$actual" != "$(cat "$expected")" ]; then
+      echo "FAIL $expected ($3)"
+      echo "$actual" | diff "$expected" - | sed 's/^/  /'
+      failed=1
+    fi
+  done
+}
+
+# Runs a fixture directory in a fresh kvs.
+# $1: fixture directory, $2: kvs options, $3: number of times the directory is run.
+run_fixture() {
+  scratch=$(mktemp -d) || exit 1
+  cp "$1"/* "$scratch"
+  rm -f "$scratch"/*.out "$scratch"/*.restore "$scratch"/*.bck "$scratch"/*.replay
+
+  options=$2
+  if ls "$1"/*.replay >/dev/null 2>&1; then
+    options="$options -t $scratch.trace"
+  fi
+
+  commands=$(printf "OPENDIR .\n%.0s" $(seq "$3"))
+  # shellcheck disable=SC2086 # Options are split on purpose
+  (cd "$scratch" && printf "%s\nQUIT\n" "$commands" | "$KVS" $options >/dev/null 2>&1)
+  check_outputs "$1" "$scratch" "options: '$2', runs: $3"
+
+  rm -rf "$scratch" "$scratch.trace"
+}
+
+# Watches a scratch tree while it changes: jobs already in it (one nested, one
+# skipped as its output is newer), a job in a directory created during the watch
+# and jobs written into directories after their parent was renamed.
+check_watch() {
+  scratch=$(mktemp -d) || exit 1
+  mkdir -p "$scratch/sub/deep"
+  printf "WRITE [(a,1)]\nREAD [a]\n" >"$scratch/top.job"
+  printf "WRITE [(b,2)]\nREAD [b]\n" >"$scratch/sub/nested.job"
+  printf "READ [c]\n" >"$scratch/skipped.job"
+  echo "untouched" >"$scratch/skipped.out"
+  touch -d "2000-01-01" "$scratch/skipped.job"
+
+  # Events are handled in order, the pauses only give kvs time to catch up before the next step
+  (cd "$scratch" && {
+    printf "WATCH .\n"
+    sleep 1
+    mkdir new
+    printf "WRITE [(d,4)]\nREAD [d]\n" >new/created.job
+    mv sub moved
+    sleep 1
+    printf "WRITE [(e,5)]\nREAD [e]\n" >moved/renamed.job
+    printf "WRITE [(f,6)]\nREAD [f]\n" >moved/deep/renamed.job
+    sleep 1
+    printf "QUIT\n"
+  } | "$KVS" >/dev/null 2>&1)
+
+  for expected in "top.out:[(a,1)]" "moved/nested.out:[(b,2)]" "skipped.out:untouched" "new/created.out:[(d,4)]" \
+    "moved/renamed.out:[(e,5)]" "moved/deep/renamed.out:[(f,6)]"; do
+    name=${expected%%:*}
+    actual=$(cat "$scratch/$name" 2>/dev/null)
+    if [ "$actual" != "${expected#*:}" ]; then
+      echo "FAIL WATCH $name: expected '${expected#*:}', got '$actual'"
+      failed=1
+    fi
+  done
+
+  rm -rf "$scratch"
+}
+
+check_watch
+
+for dir in jobs/*/; do
+  dir=${dir%/}
+  for options in "" "-p" "-u" "-p -u" "-g -w 2" "-g -w 4" "-x index"; do
+    run_fixture "$dir" "$options" 1
+    if ls "$dir"/*.restore >/dev/null 2>&1; then
+      run_fixture "$dir" "$options" 2
+    fi
+  done
+done
+
+if [ "$failed" -eq 0 ]; then
+  echo "All fixtures passed"
+fi
+exit "$failed"
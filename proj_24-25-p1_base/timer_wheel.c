@@ -0,0 +1,188 @@
+#include "timer_wheel.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "constants.h"
+
+uint64_t timer_now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static uint64_t ms_to_tick(uint64_t ms) {
+  // Round up, so an entry never fires before its expiration time
+  return (ms + TTL_TICK_MS - 1) / TTL_TICK_MS;
+}
+
+static void list_push(TimerEntry **head, TimerEntry *entry) {
+  entry->slot = head;
+  entry->prev = NULL;
+  entry->next = *head;
+  if (*head != NULL) {
+    (*head)->prev = entry;
+  }
+  *head = entry;
+}
+
+// Places an entry in the slot that matches its distance to the current tick.
+static void wheel_insert(TimerWheel *wheel, TimerEntry *entry) {
+  uint64_t tick = entry->tick < wheel->current ? wheel->current : entry->tick;
+  uint64_t delta = tick - wheel->current;
+
+  for (int level = 0; level < WHEEL_LEVELS; level++) {
+    if (delta < ((uint64_t)1 << (WHEEL_BITS * (level + 1)))) {
+      size_t slot = (size_t)((tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+      list_push(&wheel->slots[level][slot], entry);
+      return;
+    }
+  }
+
+  list_push(&wheel->overflow, entry);
+}
+
+static void wheel_unlink(TimerEntry *entry) {
+  if (entry->prev != NULL) {
+    entry->prev->next = entry->next;
+  } else {
+    *entry->slot = entry->next;
+  }
+
+  if (entry->next != NULL) {
+    entry->next->prev = entry->prev;
+  }
+
+  entry->slot = NULL;
+  entry->prev = NULL;
+  entry->next = NULL;
+}
+
+// Moves every entry of a slot to the levels below it.
+static void wheel_cascade(TimerWheel *wheel, TimerEntry **head) {
+  TimerEntry *entry = *head;
+  *head = NULL;
+
+  while (entry != NULL) {
+    TimerEntry *next = entry->next;
+    wheel_insert(wheel, entry);
+    entry = next;
+  }
+}
+
+int timer_wheel_init(TimerWheel *wheel) {
+  memset(wheel->slots, 0, sizeof(wheel->slots));
+  wheel->overflow = NULL;
+  wheel->current = timer_now_ms() / TTL_TICK_MS;
+  return pthread_mutex_init(&wheel->lock, NULL) != 0;
+}
+
+void timer_wheel_destroy(TimerWheel *wheel) {
+  for (int level = 0; level < WHEEL_LEVELS; level++) {
+    for (size_t slot = 0; slot < WHEEL_SLOTS; slot++) {
+      timer_entry_free(wheel->slots[level][slot]);
+      wheel->slots[level][slot] = NULL;
+    }
+  }
+  timer_entry_free(wheel->overflow);
+  wheel->overflow = NULL;
+  pthread_mutex_destroy(&wheel->lock);
+}
+
+int timer_wheel_schedule(TimerWheel *wheel, TimerEntry **owner, const char *key, uint64_t expires_at) {
+  TimerEntry *entry = malloc(sizeof(TimerEntry));
+  if (entry == NULL) {
+    return 1;
+  }
+
+  entry->key = strdup(key);
+  if (entry->key == NULL) {
+    free(entry);
+    return 1;
+  }
+  entry->expires_at = expires_at;
+  entry->owner = owner;
+
+  pthread_mutex_lock(&wheel->lock);
+  if (*owner != NULL) {
+    TimerEntry *old = *owner;
+    wheel_unlink(old);
+    free(old->key);
+    free(old);
+  }
+
+  // The current tick has already been processed, so fire on the next one at the earliest
+  entry->tick = ms_to_tick(expires_at);
+  if (entry->tick <= wheel->current) {
+    entry->tick = wheel->current + 1;
+  }
+  wheel_insert(wheel, entry);
+  *owner = entry;
+  pthread_mutex_unlock(&wheel->lock);
+
+  return 0;
+}
+
+void timer_wheel_cancel(TimerWheel *wheel, TimerEntry **owner) {
+  pthread_mutex_lock(&wheel->lock);
+  TimerEntry *entry = *owner;
+  if (entry != NULL) {
+    wheel_unlink(entry);
+    *owner = NULL;
+  }
+  pthread_mutex_unlock(&wheel->lock);
+
+  if (entry != NULL) {
+    free(entry->key);
+    free(entry);
+  }
+}
+
+TimerEntry *timer_wheel_advance(TimerWheel *wheel, uint64_t now_ms) {
+  TimerEntry *expired = NULL;
+  uint64_t target = now_ms / TTL_TICK_MS;
+
+  pthread_mutex_lock(&wheel->lock);
+  while (wheel->current < target) {
+    uint64_t tick = ++wheel->current;
+
+    if ((tick & WHEEL_MASK) == 0) {
+      int level;
+      for (level = 1; level < WHEEL_LEVELS; level++) {
+        size_t slot = (size_t)((tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+        wheel_cascade(wheel, &wheel->slots[level][slot]);
+        if (slot != 0) {
+          break;
+        }
+      }
+      if (level == WHEEL_LEVELS) {
+        wheel_cascade(wheel, &wheel->overflow);
+      }
+    }
+
+    TimerEntry **head = &wheel->slots[0][tick & WHEEL_MASK];
+    while (*head != NULL) {
+      TimerEntry *entry = *head;
+      *head = entry->next;
+      *entry->owner = NULL;
+      entry->owner = NULL;
+      entry->slot = NULL;
+      entry->prev = NULL;
+      entry->next = expired;
+      expired = entry;
+    }
+  }
+  pthread_mutex_unlock(&wheel->lock);
+
+  return expired;
+}
+
+void timer_entry_free(TimerEntry *entry) {
+  while (entry != NULL) {
+    TimerEntry *next = entry->next;
+    free(entry->key);
+    free(entry);
+    entry = next;
+  }
+}
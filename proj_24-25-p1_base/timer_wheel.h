@@ -0,0 +1,68 @@
+#ifndef KVS_TIMER_WHEEL_H
+#define KVS_TIMER_WHEEL_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "constants.h"
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+
+typedef struct TimerEntry {
+  uint64_t expires_at;         // Absolute expiration time in milliseconds
+  uint64_t tick;               // Tick in which the entry fires
+  char *key;                   // Copy of the key the entry expires
+  struct TimerEntry **owner;   // Slot that references this entry (cleared when it fires)
+  struct TimerEntry **slot;    // List head the entry is linked in
+  struct TimerEntry *prev;
+  struct TimerEntry *next;
+} TimerEntry;
+
+typedef struct TimerWheel {
+  pthread_mutex_t lock;
+  uint64_t current;            // Last tick processed
+  TimerEntry *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+  TimerEntry *overflow;        // Entries beyond the range of the top level
+} TimerWheel;
+
+/// Current time of the monotonic clock.
+/// @return Milliseconds since an unspecified starting point.
+uint64_t timer_now_ms();
+
+/// Initializes an empty timing wheel.
+/// @param wheel Wheel to be initialized.
+/// @return 0 if the wheel was initialized successfully, 1 otherwise.
+int timer_wheel_init(TimerWheel *wheel);
+
+/// Frees every pending entry of the wheel.
+/// @param wheel Wheel to be destroyed.
+void timer_wheel_destroy(TimerWheel *wheel);
+
+/// Schedules the expiration of a key, replacing the entry referenced by owner.
+/// @param wheel Wheel to schedule in.
+/// @param owner Slot that keeps the entry of the key (usually KeyNode->timer).
+/// @param key Key to be expired.
+/// @param expires_at Absolute expiration time in milliseconds.
+/// @return 0 if the entry was scheduled successfully, 1 otherwise.
+int timer_wheel_schedule(TimerWheel *wheel, TimerEntry **owner, const char *key, uint64_t expires_at);
+
+/// Cancels the entry referenced by owner, if any.
+/// @param wheel Wheel the entry was scheduled in.
+/// @param owner Slot that keeps the entry.
+void timer_wheel_cancel(TimerWheel *wheel, TimerEntry **owner);
+
+/// Advances the wheel up to the given time, detaching every entry that fired.
+/// Each tick only touches one slot per level, so the cost is O(1) per key.
+/// @param wheel Wheel to advance.
+/// @param now_ms Current time in milliseconds.
+/// @return List (linked by next) of the entries that fired, to be freed with timer_entry_free.
+TimerEntry *timer_wheel_advance(TimerWheel *wheel, uint64_t now_ms);
+
+/// Frees a list of detached entries.
+/// @param entry First entry of the list.
+void timer_entry_free(TimerEntry *entry);
+
+#endif  // KVS_TIMER_WHEEL_H
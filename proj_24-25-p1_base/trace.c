@@ -0,0 +1,298 @@
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Largest payload: a WRITE of MAX_WRITE_SIZE pairs, with lengths and TTLs as varints.
+#define TRACE_MAX_PAYLOAD (MAX_WRITE_SIZE * (2 * MAX_STRING_SIZE + 8) + MAX_JOB_FILE_NAME_SIZE + 16)
+#define TRACE_MAX_HEADER 32
+#define TRACE_BUFFER_SIZE (64 * 1024)
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *trace_file = NULL;
+static uint64_t trace_start_us;
+static uint64_t trace_last_us;       // Time of the last entry written, entries store the difference
+static uint32_t trace_sessions;
+static uint8_t trace_payload[TRACE_MAX_PAYLOAD];
+
+static uint64_t now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static size_t put_varint(uint8_t *buf, uint64_t value) {
+  size_t len = 0;
+  while (value >= 0x80) {
+    buf[len++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  buf[len++] = (uint8_t)value;
+  return len;
+}
+
+static size_t put_string(uint8_t *buf, const char *str) {
+  size_t str_len = strlen(str);
+  size_t len = put_varint(buf, str_len);
+  memcpy(buf + len, str, str_len);
+  return len + str_len;
+}
+
+// Writes an entry with the payload in trace_payload. Must be called with the trace lock held.
+static void write_entry(uint8_t tag, uint32_t session_id, size_t payload_len) {
+  uint64_t now = now_us() - trace_start_us;
+  // Entries of concurrent sessions may race for the lock, so never go back in time
+  if (now < trace_last_us) {
+    now = trace_last_us;
+  }
+
+  uint8_t header[TRACE_MAX_HEADER];
+  size_t len = 0;
+  header[len++] = tag;
+  len += put_varint(header + len, now - trace_last_us);
+  len += put_varint(header + len, session_id);
+  len += put_varint(header + len, payload_len);
+  trace_last_us = now;
+
+  if (fwrite(header, 1, len, trace_file) != len ||
+      fwrite(trace_payload, 1, payload_len, trace_file) != payload_len) {
+    perror("Failed to write trace, stopping the capture");
+    fclose(trace_file);
+    trace_file = NULL;
+  }
+}
+
+int trace_open(const char *path) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    perror("Failed to open trace file");
+    return 1;
+  }
+  setvbuf(file, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+  if (fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_SIZE, file) != TRACE_MAGIC_SIZE) {
+    perror("Failed to write trace file");
+    fclose(file);
+    return 1;
+  }
+
+  pthread_mutex_lock(&trace_lock);
+  trace_file = file;
+  trace_start_us = now_us();
+  trace_last_us = 0;
+  trace_sessions = 0;
+  pthread_mutex_unlock(&trace_lock);
+  return 0;
+}
+
+void trace_close() {
+  pthread_mutex_lock(&trace_lock);
+  if (trace_file != NULL && fclose(trace_file) != 0) {
+    perror("Failed to close trace file");
+  }
+  trace_file = NULL;
+  pthread_mutex_unlock(&trace_lock);
+}
+
+uint32_t trace_session(const char *name) {
+  pthread_mutex_lock(&trace_lock);
+  if (trace_file == NULL) {
+    pthread_mutex_unlock(&trace_lock);
+    return 0;
+  }
+
+  uint32_t session_id = ++trace_sessions;
+  char truncated[MAX_JOB_FILE_NAME_SIZE];
+  snprintf(truncated, sizeof(truncated), "%s", name);
+  write_entry(TRACE_TAG_SESSION, session_id, put_string(trace_payload, truncated));
+  pthread_mutex_unlock(&trace_lock);
+  return session_id;
+}
+
+void trace_command(uint32_t session_id, const CommandRecord *record) {
+  if (session_id == 0) {
+    return;
+  }
+
+  switch (record->cmd) {
+    case CMD_WRITE:
+    case CMD_READ:
+    case CMD_DELETE:
+    case CMD_SHOW:
+    case CMD_STATS:
+    case CMD_HOTKEYS:
+    case CMD_WAIT:
+    case CMD_BACKUP:
+    case CMD_LOAD:
+      break;
+
+    case CMD_HELP:
+    case CMD_EMPTY:
+    case CMD_INVALID:
+    case CMD_OPENDIR:
+    case CMD_WATCH:
+    case CMD_QUIT:
+    case EOC:
+      return; // Nothing worth replaying
+  }
+
+  pthread_mutex_lock(&trace_lock);
+  if (trace_file == NULL) {
+    pthread_mutex_unlock(&trace_lock);
+    return;
+  }
+
+  size_t len = 0;
+  if (record->cmd == CMD_WRITE || record->cmd == CMD_READ || record->cmd == CMD_DELETE) {
+    len += put_varint(trace_payload, record->num_pairs);
+    for (size_t i = 0; i < record->num_pairs; i++) {
+      len += put_string(trace_payload + len, record->keys[i]);
+      if (record->cmd == CMD_WRITE) {
+        len += put_string(trace_payload + len, record->values[i]);
+        len += put_varint(trace_payload + len, record->ttls[i]);
+      }
+    }
+  } else if (record->cmd == CMD_WAIT) {
+    len += put_varint(trace_payload, record->delay);
+  } else if (record->cmd == CMD_LOAD) {
+    len += put_string(trace_payload, record->path);
+  }
+  write_entry((uint8_t)record->cmd, session_id, len);
+  pthread_mutex_unlock(&trace_lock);
+}
+
+int trace_cursor_init(TraceCursor *cursor, const uint8_t *data, size_t size) {
+  if (size < TRACE_MAGIC_SIZE || memcmp(data, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0) {
+    return 1;
+  }
+
+  cursor->data = data;
+  cursor->size = size;
+  cursor->offset = TRACE_MAGIC_SIZE;
+  cursor->time_us = 0;
+  return 0;
+}
+
+// Reads a varint, advancing the offset.
+// @return 0 if a varint was read, 1 if it runs past the end.
+static int get_varint(const uint8_t *data, size_t size, size_t *offset, uint64_t *value) {
+  *value = 0;
+  for (unsigned int shift = 0; shift < 64; shift += 7) {
+    if (*offset >= size) {
+      return 1;
+    }
+    uint8_t byte = data[(*offset)++];
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Reads a string into a buffer of the given size, advancing the offset.
+// @return 0 if the string was read, 1 if it is truncated or does not fit.
+static int get_string(const uint8_t *data, size_t size, size_t *offset, char *str, size_t str_size) {
+  uint64_t len;
+  if (get_varint(data, size, offset, &len) != 0 || len >= str_size || len > size - *offset) {
+    return 1;
+  }
+  memcpy(str, data + *offset, len);
+  str[len] = '\0';
+  *offset += len;
+  return 0;
+}
+
+int trace_next(TraceCursor *cursor, TraceEvent *event) {
+  if (cursor->offset == cursor->size) {
+    return 0;
+  }
+
+  uint8_t tag = cursor->data[cursor->offset++];
+  uint64_t delta;
+  uint64_t session_id;
+  uint64_t payload_len;
+  if (get_varint(cursor->data, cursor->size, &cursor->offset, &delta) != 0 ||
+      get_varint(cursor->data, cursor->size, &cursor->offset, &session_id) != 0 ||
+      get_varint(cursor->data, cursor->size, &cursor->offset, &payload_len) != 0 ||
+      session_id == 0 || session_id > UINT32_MAX || payload_len > cursor->size - cursor->offset ||
+      (tag != TRACE_TAG_SESSION && tag >= EOC)) {
+    return -1;
+  }
+
+  cursor->time_us += delta;
+  event->session = tag == TRACE_TAG_SESSION;
+  event->cmd = event->session ? CMD_EMPTY : (enum Command)tag;
+  event->time_us = cursor->time_us;
+  event->session_id = (uint32_t)session_id;
+  event->payload = cursor->data + cursor->offset;
+  event->payload_len = (size_t)payload_len;
+  cursor->offset += (size_t)payload_len;
+  return 1;
+}
+
+void trace_decode_command(const TraceEvent *event, CommandRecord *record) {
+  const uint8_t *data = event->payload;
+  size_t size = event->payload_len;
+  size_t offset = 0;
+  uint64_t value;
+
+  record->cmd = event->cmd;
+  switch (event->cmd) {
+    case CMD_WRITE:
+    case CMD_READ:
+    case CMD_DELETE:
+      if (get_varint(data, size, &offset, &value) != 0 || value == 0 || value > MAX_WRITE_SIZE) {
+        record->cmd = CMD_INVALID;
+        return;
+      }
+      record->num_pairs = (size_t)value;
+      for (size_t i = 0; i < record->num_pairs; i++) {
+        if (get_string(data, size, &offset, record->keys[i], MAX_STRING_SIZE) != 0) {
+          record->cmd = CMD_INVALID;
+          return;
+        }
+        if (event->cmd != CMD_WRITE) {
+          continue;
+        }
+        if (get_string(data, size, &offset, record->values[i], MAX_STRING_SIZE) != 0 ||
+            get_varint(data, size, &offset, &value) != 0 || value > UINT32_MAX) {
+          record->cmd = CMD_INVALID;
+          return;
+        }
+        record->ttls[i] = (unsigned int)value;
+      }
+      break;
+
+    case CMD_WAIT:
+      if (get_varint(data, size, &offset, &value) != 0 || value > UINT32_MAX) {
+        record->cmd = CMD_INVALID;
+        return;
+      }
+      record->delay = (unsigned int)value;
+      break;
+
+    case CMD_LOAD:
+      if (get_string(data, size, &offset, record->path, sizeof(record->path)) != 0) {
+        record->cmd = CMD_INVALID;
+      }
+      break;
+
+    case CMD_SHOW:
+    case CMD_STATS:
+    case CMD_HOTKEYS:
+    case CMD_BACKUP:
+      break;
+
+    case CMD_HELP:
+    case CMD_EMPTY:
+    case CMD_INVALID:
+    case CMD_OPENDIR:
+    case CMD_WATCH:
+    case CMD_QUIT:
+    case EOC:
+      record->cmd = CMD_INVALID; // Never captured
+      break;
+  }
+}
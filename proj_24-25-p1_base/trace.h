@@ -0,0 +1,75 @@
+#ifndef KVS_TRACE_H
+#define KVS_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "command.h"
+
+// A trace starts with this magic, followed by entries made of a tag byte
+// (TRACE_TAG_SESSION or the enum Command of the command), the microseconds
+// since the previous entry, the session, the payload length and the payload.
+// Numbers are LEB128 varints and strings are a varint length and the bytes.
+// A session payload is its name; a command payload holds its arguments:
+// pairs of WRITE (key, value, ttl), keys of READ and DELETE, delay of WAIT
+// and the path of LOAD.
+#define TRACE_MAGIC "KVSTRACE"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_TAG_SESSION 0xFF
+
+typedef struct TraceEvent {
+  bool session;             // Whether the entry names a session rather than being a command
+  enum Command cmd;
+  uint64_t time_us;         // Since the start of the capture
+  uint32_t session_id;
+  const uint8_t *payload;
+  size_t payload_len;
+} TraceEvent;
+
+// Position in a trace loaded in memory.
+typedef struct TraceCursor {
+  const uint8_t *data;
+  size_t size;
+  size_t offset;
+  uint64_t time_us;         // Time of the last entry read
+} TraceCursor;
+
+/// Starts capturing the executed commands into a trace file.
+/// @param path Path of the trace, truncated if it exists.
+/// @return 0 if the capture was started, 1 otherwise.
+int trace_open(const char *path);
+
+/// Stops the capture and flushes the trace.
+void trace_close();
+
+/// Starts a session, the prompt or a job, naming it in the trace.
+/// @param name Name of the session.
+/// @return Id of the session, 0 if no trace is being captured.
+uint32_t trace_session(const char *name);
+
+/// Appends a command to the trace. Does nothing if no trace is being
+/// captured or the session is 0.
+/// @param session_id Session executing the command.
+/// @param record Command being executed.
+void trace_command(uint32_t session_id, const CommandRecord *record);
+
+/// Starts reading a trace loaded in memory.
+/// @param cursor Cursor to be initialized.
+/// @param data Contents of the trace file.
+/// @param size Size of the contents.
+/// @return 0 if the data starts with the trace magic, 1 otherwise.
+int trace_cursor_init(TraceCursor *cursor, const uint8_t *data, size_t size);
+
+/// Reads the next entry of a trace, without decoding its payload.
+/// @param cursor Cursor to read from.
+/// @param event Where to store the entry.
+/// @return 1 if an entry was read, 0 at the end of the trace, -1 if the trace is corrupted.
+int trace_next(TraceCursor *cursor, TraceEvent *event);
+
+/// Decodes the arguments of a command entry.
+/// @param event Command entry.
+/// @param record Record to be filled; its cmd is CMD_INVALID if the payload is corrupted.
+void trace_decode_command(const TraceEvent *event, CommandRecord *record);
+
+#endif  // KVS_TRACE_H
@@ -0,0 +1,231 @@
+#include "watch.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "operations.h"
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_MOVE_SELF)
+
+typedef struct WatchedDir {
+  int wd;
+  char path[MAX_JOB_FILE_NAME_SIZE];
+} WatchedDir;
+
+typedef struct Watcher {
+  int fd;
+  int root_wd;
+  char root[MAX_JOB_FILE_NAME_SIZE];  // Path of the tree, rescanned if events are lost
+  WatchedDir *dirs;
+  size_t num_dirs;
+  size_t capacity;
+} Watcher;
+
+static WatchedDir *watched_dir(const Watcher *watcher, int wd) {
+  for (size_t i = 0; i < watcher->num_dirs; i++) {
+    if (watcher->dirs[i].wd == wd) {
+      return &watcher->dirs[i];
+    }
+  }
+  return NULL;
+}
+
+static void forget_dir(Watcher *watcher, int wd) {
+  for (size_t i = 0; i < watcher->num_dirs; i++) {
+    if (watcher->dirs[i].wd == wd) {
+      watcher->dirs[i] = watcher->dirs[--watcher->num_dirs];
+      return;
+    }
+  }
+}
+
+// Stops watching a directory and its subdirectories, which are no longer at the given path.
+static void unwatch_tree(Watcher *watcher, const char *path) {
+  size_t len = strlen(path);
+  for (size_t i = 0; i < watcher->num_dirs;) {
+    const char *dir_path = watcher->dirs[i].path;
+    if (strncmp(dir_path, path, len) == 0 && (dir_path[len] == '\0' || dir_path[len] == '/')) {
+      inotify_rm_watch(watcher->fd, watcher->dirs[i].wd);
+      watcher->dirs[i] = watcher->dirs[--watcher->num_dirs]; // Its IN_IGNORED finds nothing to forget
+    } else {
+      i++;
+    }
+  }
+}
+
+// Watches a directory and its subdirectories, running the jobs already in them.
+// The watch is added before the scan, so no job closed meanwhile is missed.
+static int watch_tree(Watcher *watcher, const char *path) {
+  int wd = inotify_add_watch(watcher->fd, path, WATCH_EVENTS);
+  if (wd < 0) {
+    perror("Failed to watch directory");
+    return 1;
+  }
+
+  WatchedDir *watched = watched_dir(watcher, wd);
+  if (watched != NULL) {
+    // Already watched, maybe under the path it had before a rename whose events were lost
+    strcpy(watched->path, path);
+  } else {
+    if (watcher->num_dirs == watcher->capacity) {
+      size_t capacity = watcher->capacity == 0 ? 16 : watcher->capacity * 2;
+      WatchedDir *dirs = realloc(watcher->dirs, capacity * sizeof(WatchedDir));
+      if (dirs == NULL) {
+        inotify_rm_watch(watcher->fd, wd);
+        return 1;
+      }
+      watcher->dirs = dirs;
+      watcher->capacity = capacity;
+    }
+    watcher->dirs[watcher->num_dirs].wd = wd;
+    strcpy(watcher->dirs[watcher->num_dirs].path, path);
+    watcher->num_dirs++;
+  }
+
+  DIR *dir = opendir(path);
+  if (dir == NULL) {
+    perror("Failed to open directory");
+    return 1;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+
+    // Symbolic links to directories are not followed, as they may point back up the tree
+    char entry_path[MAX_JOB_FILE_NAME_SIZE];
+    struct stat entry_stat;
+    if (kvs_join_path(path, entry->d_name, entry_path, sizeof(entry_path)) != 0 ||
+        lstat(entry_path, &entry_stat) != 0) {
+      continue;
+    }
+
+    if (S_ISDIR(entry_stat.st_mode)) {
+      watch_tree(watcher, entry_path);
+    } else if (kvs_is_job(entry->d_name)) {
+      kvs_process_job(entry_path, 1);
+    }
+  }
+
+  closedir(dir);
+  return 0;
+}
+
+// Handles one inotify event.
+// @return 1 if the root of the tree is gone, 0 otherwise.
+static int handle_event(Watcher *watcher, const struct inotify_event *event) {
+  if (event->mask & IN_Q_OVERFLOW) {
+    // Jobs closed while the queue was full have no event, rescan for them (and for new directories)
+    fprintf(stderr, "Watch events were lost, rescanning %s\n", watcher->root);
+    watch_tree(watcher, watcher->root);
+    return 0;
+  }
+
+  if (event->mask & IN_IGNORED) {
+    forget_dir(watcher, event->wd);
+    return event->wd == watcher->root_wd;
+  }
+
+  if ((event->mask & IN_MOVE_SELF) && event->wd == watcher->root_wd) {
+    // Every path would be stale; subdirectories are handled by the events of their parents
+    fprintf(stderr, "Watched directory %s was moved\n", watcher->root);
+    return 1;
+  }
+
+  const WatchedDir *dir = watched_dir(watcher, event->wd);
+  if (dir == NULL || event->len == 0) {
+    return 0;
+  }
+
+  char path[MAX_JOB_FILE_NAME_SIZE];
+  if (kvs_join_path(dir->path, event->name, path, sizeof(path)) != 0) {
+    return 0;
+  }
+
+  if (event->mask & IN_ISDIR) {
+    // A renamed directory is watched again from scratch where it lands, if it stays in the tree.
+    // IN_ISDIR is not set on symbolic links, so they are not followed here either.
+    if (event->mask & IN_MOVED_FROM) {
+      unwatch_tree(watcher, path);
+    } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+      watch_tree(watcher, path);
+    }
+  } else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && kvs_is_job(event->name)) {
+    kvs_process_job(path, 1);
+  }
+
+  return 0;
+}
+
+void kvs_watch_directory(const char *directory_path) {
+  Watcher watcher = {.fd = -1, .root_wd = -1, .dirs = NULL, .num_dirs = 0, .capacity = 0};
+  if (strlen(directory_path) >= sizeof(watcher.root)) {
+    fprintf(stderr, "Path too long: %s\n", directory_path);
+    return;
+  }
+  strcpy(watcher.root, directory_path);
+
+  watcher.fd = inotify_init();
+  if (watcher.fd < 0) {
+    perror("Failed to initialize inotify");
+    return;
+  }
+
+  if (watch_tree(&watcher, directory_path) != 0 || watcher.num_dirs == 0) {
+    close(watcher.fd);
+    free(watcher.dirs);
+    return;
+  }
+  watcher.root_wd = watcher.dirs[0].wd;
+
+  // Events are aligned like the structure they hold
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct pollfd fds[2] = {
+      {.fd = watcher.fd, .events = POLLIN, .revents = 0},
+      {.fd = STDIN_FILENO, .events = POLLIN, .revents = 0},
+  };
+  int done = 0;
+
+  while (!done) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      break;
+    }
+
+    // Any input (or the end of it) ends the watch, the REPL reads the next command
+    if (fds[1].revents != 0) {
+      break;
+    }
+
+    if ((fds[0].revents & POLLIN) == 0) {
+      continue;
+    }
+
+    ssize_t len = read(watcher.fd, buffer, sizeof(buffer));
+    if (len <= 0) {
+      break;
+    }
+
+    for (char *ptr = buffer; ptr < buffer + len && !done;) {
+      const struct inotify_event *event = (const struct inotify_event *)(void *)ptr;
+      done = handle_event(&watcher, event);
+      ptr += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  close(watcher.fd);
+  free(watcher.dirs);
+}
@@ -0,0 +1,11 @@
+#ifndef KVS_WATCH_H
+#define KVS_WATCH_H
+
+/// Runs the jobs of a directory tree and keeps running new ones as soon as
+/// they are closed after writing (or moved into the tree), until input
+/// arrives on stdin or the directory is removed. Jobs whose .out is newer
+/// than the job are skipped.
+/// @param directory_path Root of the tree to watch.
+void kvs_watch_directory(const char *directory_path);
+
+#endif  // KVS_WATCH_H
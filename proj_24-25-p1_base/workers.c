@@ -0,0 +1,237 @@
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Removes a job from the queue. Must be called with the pool lock held.
+static void dequeue_job(WorkerPool *pool, WorkerJob *job) {
+  for (WorkerJob **link = &pool->jobs; *link != NULL; link = &(*link)->next_job) {
+    if (*link == job) {
+      *link = job->next_job;
+      return;
+    }
+  }
+}
+
+// Claims a task of a job, dequeuing it once every task is claimed. Must be called with the pool lock held.
+// @return Index of the task, job->count if none is left.
+static size_t claim_task(WorkerPool *pool, WorkerJob *job) {
+  if (job->next >= job->count) {
+    return job->count;
+  }
+
+  size_t task = job->next++;
+  if (job->next == job->count) {
+    dequeue_job(pool, job);
+  }
+  return task;
+}
+
+// Marks a task as done, waking the caller of the job if it was the last one.
+// The job must not be touched afterwards, as its caller may return.
+static void finish_task(WorkerPool *pool, WorkerJob *job) {
+  pthread_mutex_lock(&pool->lock);
+  if (++job->done == job->count) {
+    pthread_cond_broadcast(&pool->finished);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void *worker_main(void *arg) {
+  WorkerPool *pool = arg;
+
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (!pool->stopping && pool->jobs == NULL) {
+      pthread_cond_wait(&pool->work, &pool->lock);
+    }
+    if (pool->stopping) {
+      break;
+    }
+
+    WorkerJob *job = pool->jobs;
+    size_t task = claim_task(pool, job);
+    pthread_mutex_unlock(&pool->lock);
+
+    job->fn(job->arg, task);
+    finish_task(pool, job);
+
+    pthread_mutex_lock(&pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+int worker_pool_init(WorkerPool *pool, size_t num_threads, const CpuSet *cpus) {
+  pool->threads = NULL;
+  pool->cpus = NULL;
+  pool->num_threads = 0;
+  pool->jobs = NULL;
+  pool->stopping = false;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->finished, NULL);
+
+  if (num_threads == 0) {
+    return 0;
+  }
+
+  pool->threads = malloc(num_threads * sizeof(pthread_t));
+  pool->cpus = malloc(num_threads * sizeof(int));
+  if (pool->threads == NULL || pool->cpus == NULL) {
+    worker_pool_destroy(pool);
+    return 1;
+  }
+
+  for (size_t i = 0; i < num_threads; i++) {
+    if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+      fprintf(stderr, "Failed to start worker thread\n");
+      worker_pool_destroy(pool);
+      return 1;
+    }
+
+    // Pinned before the thread claims any task, so what its tasks allocate comes from its node
+    pool->cpus[i] = -1;
+    if (cpus != NULL && !cpu_set_empty(cpus)) {
+      int cpu = cpu_set_nth(cpus, i + 1);
+      if (affinity_pin(pool->threads[i], cpu) == 0) {
+        pool->cpus[i] = cpu;
+      } else {
+        fprintf(stderr, "Failed to pin worker thread to CPU %d\n", cpu);
+      }
+    }
+    pool->num_threads++;
+  }
+
+  return 0;
+}
+
+void worker_pool_run(WorkerPool *pool, size_t count, WorkerTask fn, void *arg) {
+  if (count == 0) {
+    return;
+  }
+
+  if (pool->num_threads == 0 || count == 1) {
+    for (size_t i = 0; i < count; i++) {
+      fn(arg, i);
+    }
+    return;
+  }
+
+  WorkerJob job = {.fn = fn, .arg = arg, .count = count, .next = 0, .done = 0, .next_job = NULL};
+
+  pthread_mutex_lock(&pool->lock);
+  WorkerJob **link = &pool->jobs;
+  while (*link != NULL) {
+    link = &(*link)->next_job;
+  }
+  *link = &job;
+  pthread_cond_broadcast(&pool->work);
+
+  // Run tasks on the caller as well, so nested loops always make progress
+  while (1) {
+    size_t task = claim_task(pool, &job);
+    if (task == count) {
+      break;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    fn(arg, task);
+
+    pthread_mutex_lock(&pool->lock);
+    job.done++;
+  }
+
+  while (job.done < count) {
+    pthread_cond_wait(&pool->finished, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// Loop of worker_pool_write, with a buffer per task.
+typedef struct WriteJob {
+  WorkerWriteTask fn;
+  void *arg;
+  char **buffers;
+  size_t *sizes;
+  int *results;
+} WriteJob;
+
+static void write_task(void *arg, size_t task) {
+  WriteJob *job = arg;
+  FILE *out = open_memstream(&job->buffers[task], &job->sizes[task]);
+  if (out == NULL) {
+    perror("Failed to buffer task output");
+    job->results[task] = 1;
+    return;
+  }
+  job->results[task] = job->fn(job->arg, task, out);
+  if (fclose(out) != 0) {
+    job->results[task] = 1;
+  }
+}
+
+int worker_pool_write(WorkerPool *pool, size_t count, WorkerWriteTask fn, void *arg, FILE *out) {
+  int result = 0;
+
+  // Nothing runs in parallel, so buffering would only add copies
+  if (pool->num_threads == 0 || count <= 1) {
+    for (size_t i = 0; i < count; i++) {
+      result |= fn(arg, i, out);
+    }
+    return result;
+  }
+
+  WriteJob job = {.fn = fn, .arg = arg};
+  job.buffers = calloc(count, sizeof(char *));
+  job.sizes = calloc(count, sizeof(size_t));
+  job.results = calloc(count, sizeof(int));
+  if (job.buffers == NULL || job.sizes == NULL || job.results == NULL) {
+    free(job.buffers);
+    free(job.sizes);
+    free(job.results);
+    for (size_t i = 0; i < count; i++) {
+      result |= fn(arg, i, out);
+    }
+    return result;
+  }
+
+  worker_pool_run(pool, count, write_task, &job);
+
+  for (size_t i = 0; i < count; i++) {
+    if (job.buffers[i] != NULL && fwrite(job.buffers[i], 1, job.sizes[i], out) != job.sizes[i]) {
+      result = 1;
+    }
+    result |= job.results[i];
+    free(job.buffers[i]);
+  }
+  free(job.buffers);
+  free(job.sizes);
+  free(job.results);
+  return result;
+}
+
+size_t worker_pool_width(const WorkerPool *pool) {
+  return pool->num_threads + 1;
+}
+
+void worker_pool_destroy(WorkerPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (size_t i = 0; i < pool->num_threads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  free(pool->threads);
+  free(pool->cpus);
+  pool->threads = NULL;
+  pool->cpus = NULL;
+  pool->num_threads = 0;
+  pthread_cond_destroy(&pool->finished);
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->lock);
+}
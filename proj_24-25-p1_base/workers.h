@@ -0,0 +1,80 @@
+#ifndef KVS_WORKERS_H
+#define KVS_WORKERS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "affinity.h"
+
+/// Task of a parallel loop.
+/// @param arg Argument shared by every task of the loop.
+/// @param task Index of the task.
+typedef void (*WorkerTask)(void *arg, size_t task);
+
+/// Task of a parallel loop whose output is kept in order.
+/// @param arg Argument shared by every task of the loop.
+/// @param task Index of the task.
+/// @param out Stream the task writes its output to.
+/// @return 0 if the output was written successfully, 1 otherwise.
+typedef int (*WorkerWriteTask)(void *arg, size_t task, FILE *out);
+
+// Parallel loop waiting for its tasks to be claimed.
+typedef struct WorkerJob {
+  WorkerTask fn;
+  void *arg;
+  size_t count;                // Number of tasks
+  size_t next;                 // Next task to be claimed
+  size_t done;                 // Tasks finished
+  struct WorkerJob *next_job;
+} WorkerJob;
+
+typedef struct WorkerPool {
+  pthread_t *threads;
+  int *cpus;                   // CPU each thread is pinned to, -1 if it is not
+  size_t num_threads;
+  pthread_mutex_t lock;
+  pthread_cond_t work;         // Signaled when a job is queued or the pool stops
+  pthread_cond_t finished;     // Signaled when a job finishes
+  WorkerJob *jobs;             // Jobs with unclaimed tasks, oldest first
+  bool stopping;
+} WorkerPool;
+
+/// Starts the threads of a pool.
+/// @param pool Pool to be initialized.
+/// @param num_threads Number of threads, 0 to run every loop on its caller.
+/// @param cpus CPUs to pin the threads to, one each from the second CPU of the
+/// set on (the first is left to the caller), NULL or empty to leave them unpinned.
+/// @return 0 if the pool was started successfully, 1 otherwise.
+int worker_pool_init(WorkerPool *pool, size_t num_threads, const CpuSet *cpus);
+
+/// Runs a parallel loop and waits for it to finish. The caller runs tasks
+/// too, so loops may be nested in tasks without deadlocking the pool.
+/// @param pool Pool to run on.
+/// @param count Number of tasks.
+/// @param fn Task to run for each index in [0, count).
+/// @param arg Argument passed to every task.
+void worker_pool_run(WorkerPool *pool, size_t count, WorkerTask fn, void *arg);
+
+/// Runs a parallel loop whose tasks write to buffers of their own, then
+/// copies the buffers to a stream in task order, so the output is the same
+/// as running the tasks one after the other on the stream.
+/// @param pool Pool to run on.
+/// @param count Number of tasks.
+/// @param fn Task to run for each index in [0, count).
+/// @param arg Argument passed to every task.
+/// @param out Stream the output is written to.
+/// @return 0 if every task and copy succeeded, 1 otherwise.
+int worker_pool_write(WorkerPool *pool, size_t count, WorkerWriteTask fn, void *arg, FILE *out);
+
+/// Number of threads that may run the tasks of a loop, counting the caller.
+/// @param pool Pool to inspect.
+/// @return Number of threads.
+size_t worker_pool_width(const WorkerPool *pool);
+
+/// Stops and joins the threads of a pool.
+/// @param pool Pool to be destroyed.
+void worker_pool_destroy(WorkerPool *pool);
+
+#endif  // KVS_WORKERS_H